@@ -0,0 +1,194 @@
+#include "alias.hpp"
+
+#include <cassert>
+
+#include "utils.hpp"
+
+namespace KOOPA {
+
+// src and index of a getelemptr / getptr
+static bool get_ptr_operands(const koopa_raw_value_t& ptr,
+                             koopa_raw_value_t& src, koopa_raw_value_t& index) {
+  if (ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR) {
+    src = ptr->kind.data.get_elem_ptr.src;
+    index = ptr->kind.data.get_elem_ptr.index;
+    return true;
+  }
+  if (ptr->kind.tag == KOOPA_RVT_GET_PTR) {
+    src = ptr->kind.data.get_ptr.src;
+    index = ptr->kind.data.get_ptr.index;
+    return true;
+  }
+  return false;
+}
+
+void AliasAnalysis::run(const koopa_raw_function_t& func) {
+  locations.clear();
+  param_slots.clear();
+  escaped.clear();
+  leaders.clear();
+
+  // 1. count the stores to every pointer slot, and find the escaping values
+  std::unordered_map<koopa_raw_value_t, int> slot_stores;
+  std::unordered_set<koopa_raw_value_t> escaping;
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    for (int j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      if (inst->kind.tag == KOOPA_RVT_STORE) {
+        auto& store = inst->kind.data.store;
+        if (store.value->ty->tag == KOOPA_RTT_POINTER) {
+          escaping.insert(store.value);
+          slot_stores[store.dest] +=
+              store.value->kind.tag == KOOPA_RVT_FUNC_ARG_REF ? 1 : 2;
+        }
+      } else if (inst->kind.tag == KOOPA_RVT_CALL) {
+        auto& args = inst->kind.data.call.args;
+        for (int k = 0; k < args.len; ++k) {
+          auto arg = reinterpret_cast<koopa_raw_value_t>(args.buffer[k]);
+          if (arg->ty->tag == KOOPA_RTT_POINTER) {
+            escaping.insert(arg);
+          }
+        }
+      }
+    }
+  }
+  for (auto& [slot, count] : slot_stores) {
+    if (slot->kind.tag == KOOPA_RVT_ALLOC && count == 1) {
+      param_slots.insert(slot);
+    }
+  }
+  // 2. the objects those values point into
+  for (auto& value : escaping) {
+    auto& loc = locate(value);
+    if (loc.kind == MemoryLocation::Kind::LOCAL) {
+      escaped.insert(loc.base);
+    }
+  }
+}
+
+const MemoryLocation& AliasAnalysis::locate(const koopa_raw_value_t& ptr) {
+  auto it = locations.find(ptr);
+  if (it != locations.end()) {
+    return it->second;
+  }
+  MemoryLocation loc;
+  if (ptr->ty->tag == KOOPA_RTT_POINTER) {
+    loc.size = get_type_width(ptr->ty->data.pointer.base);
+  }
+  switch (ptr->kind.tag) {
+    case KOOPA_RVT_ALLOC: {
+      loc.kind = MemoryLocation::Kind::LOCAL;
+      loc.base = ptr;
+      loc.const_offset = true;
+      break;
+    }
+    case KOOPA_RVT_GLOBAL_ALLOC: {
+      loc.kind = MemoryLocation::Kind::GLOBAL;
+      loc.base = ptr;
+      loc.const_offset = true;
+      break;
+    }
+    case KOOPA_RVT_LOAD: {
+      // the pointer of an array parameter, reloaded from its slot
+      auto& src = ptr->kind.data.load.src;
+      if (param_slots.count(src)) {
+        loc.kind = MemoryLocation::Kind::PARAM;
+        loc.base = src;
+        loc.const_offset = true;
+      }
+      break;
+    }
+    case KOOPA_RVT_GET_ELEM_PTR:
+    case KOOPA_RVT_GET_PTR: {
+      bool elem = ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR;
+      koopa_raw_value_t src, index;
+      get_ptr_operands(ptr, src, index);
+      auto& src_loc = locate(src);
+      loc.kind = src_loc.kind;
+      loc.base = src_loc.base;
+      // getelemptr steps over elements of the array src points to,
+      // getptr over whole pointees of src
+      auto pointee = src->ty->data.pointer.base;
+      int stride = get_type_width(elem ? pointee->data.array.base : pointee);
+      loc.const_offset =
+          src_loc.const_offset && index->kind.tag == KOOPA_RVT_INTEGER;
+      if (loc.const_offset) {
+        loc.offset = src_loc.offset + index->kind.data.integer.value * stride;
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+  return locations[ptr] = loc;
+}
+
+AliasResult AliasAnalysis::alias(const koopa_raw_value_t& a,
+                                 const koopa_raw_value_t& b) {
+  if (a == b) {
+    return AliasResult::MUST_ALIAS;
+  }
+  // the same index into the same pointer
+  koopa_raw_value_t src_a, index_a, src_b, index_b;
+  if (a->kind.tag == b->kind.tag && get_ptr_operands(a, src_a, index_a) &&
+      get_ptr_operands(b, src_b, index_b) && same_value(index_a, index_b) &&
+      alias(src_a, src_b) == AliasResult::MUST_ALIAS) {
+    return AliasResult::MUST_ALIAS;
+  }
+  auto& loc_a = locate(a);
+  auto& loc_b = locate(b);
+  using Kind = MemoryLocation::Kind;
+  if (loc_a.kind == Kind::UNKNOWN || loc_b.kind == Kind::UNKNOWN) {
+    return AliasResult::MAY_ALIAS;
+  }
+  // (a parameter is based on its slot, which is a different object)
+  if (loc_a.kind != loc_b.kind || loc_a.base != loc_b.base) {
+    // a parameter may point into a global or into the object another
+    // parameter points into, never into our own frame
+    bool distinct = loc_a.kind == Kind::LOCAL || loc_b.kind == Kind::LOCAL ||
+                    (loc_a.kind == Kind::GLOBAL && loc_b.kind == Kind::GLOBAL);
+    return distinct ? AliasResult::NO_ALIAS : AliasResult::MAY_ALIAS;
+  }
+  // same object, compare the byte ranges
+  if (!loc_a.const_offset || !loc_b.const_offset) {
+    return AliasResult::MAY_ALIAS;
+  }
+  if (loc_a.offset == loc_b.offset && loc_a.size == loc_b.size) {
+    return AliasResult::MUST_ALIAS;
+  }
+  if (loc_a.offset + loc_a.size <= loc_b.offset ||
+      loc_b.offset + loc_b.size <= loc_a.offset) {
+    return AliasResult::NO_ALIAS;
+  }
+  return AliasResult::MAY_ALIAS;
+}
+
+bool AliasAnalysis::call_may_access(const koopa_raw_value_t& ptr) {
+  auto& loc = locate(ptr);
+  if (loc.kind == MemoryLocation::Kind::LOCAL) {
+    return escaped.count(loc.base) > 0;
+  }
+  return true;
+}
+
+void AliasAnalysis::set_equivalent(const koopa_raw_value_t& value,
+                                   const koopa_raw_value_t& leader) {
+  leaders[value] = get_leader(leader);
+}
+
+koopa_raw_value_t AliasAnalysis::get_leader(const koopa_raw_value_t& value) {
+  auto it = leaders.find(value);
+  return it == leaders.end() ? value : it->second;
+}
+
+bool AliasAnalysis::same_value(const koopa_raw_value_t& a,
+                               const koopa_raw_value_t& b) {
+  if (a->kind.tag == KOOPA_RVT_INTEGER && b->kind.tag == KOOPA_RVT_INTEGER) {
+    return a->kind.data.integer.value == b->kind.data.integer.value;
+  }
+  return get_leader(a) == get_leader(b);
+}
+
+};  // namespace KOOPA
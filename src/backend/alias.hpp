@@ -0,0 +1,73 @@
+#pragma once
+
+#include <koopa.h>
+#include "visitor.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+namespace KOOPA {
+
+/**
+ * the memory object a pointer points into, and where
+ * 1. LOCAL: an alloc of the current function (scalar or array)
+ * 2. GLOBAL: a global alloc
+ * 3. PARAM: an array parameter, i.e. the pointer loaded from the slot the
+ *    prologue stored it to. it may point into any global or any array of
+ *    a caller, but never into an alloc of the current function.
+ * 4. UNKNOWN: anything else, may point anywhere
+ * offset (in bytes from the start of the object) is only known when every
+ * getelemptr / getptr index on the way is a constant
+ */
+struct MemoryLocation {
+  enum class Kind { LOCAL, GLOBAL, PARAM, UNKNOWN };
+  Kind kind = Kind::UNKNOWN;
+  koopa_raw_value_t base = nullptr;
+  bool const_offset = false;
+  int offset = 0;
+  int size = 0;  // width of the pointee
+};
+
+enum class AliasResult { NO_ALIAS, MAY_ALIAS, MUST_ALIAS };
+
+/**
+ * alias analysis over the raw program of one function
+ *
+ * run() walks the function once to find the pointer slots of array
+ * parameters and the allocs whose address escapes (passed to a call or
+ * stored to memory). every query after that only follows the
+ * getelemptr / getptr chain of its two pointers, and the result of that
+ * walk is cached per pointer.
+ */
+class AliasAnalysis : public Visitor {
+ public:
+  void visit(const koopa_raw_function_t& func) override { run(func); }
+
+  void run(const koopa_raw_function_t& func);
+
+  const MemoryLocation& locate(const koopa_raw_value_t& ptr);
+
+  AliasResult alias(const koopa_raw_value_t& a, const koopa_raw_value_t& b);
+
+  // whether a call may read or write the memory ptr points to
+  bool call_may_access(const koopa_raw_value_t& ptr);
+
+  /**
+   * tell the analysis that value always equals leader (e.g. a load the
+   * code generator forwarded from an earlier one), so that a[%1] and a[%2]
+   * must alias if %2 is a copy of %1
+   */
+  void set_equivalent(const koopa_raw_value_t& value,
+                      const koopa_raw_value_t& leader);
+
+ private:
+  std::unordered_map<koopa_raw_value_t, MemoryLocation> locations;
+  // allocs holding the pointer of an array parameter, stored exactly once
+  std::unordered_set<koopa_raw_value_t> param_slots;
+  std::unordered_set<koopa_raw_value_t> escaped;
+  std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> leaders;
+
+  koopa_raw_value_t get_leader(const koopa_raw_value_t& value);
+  bool same_value(const koopa_raw_value_t& a, const koopa_raw_value_t& b);
+};
+
+};  // namespace KOOPA
@@ -0,0 +1,102 @@
+#include "callgraph.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace KOOPA {
+
+const CallGraphVisitor::RegSet& CallGraphVisitor::all_caller_saved() {
+  static const RegSet regs = {"ra", "t0", "t1", "t2", "t3", "t4", "t5",
+                              "t6", "a0", "a1", "a2", "a3", "a4", "a5",
+                              "a6", "a7"};
+  return regs;
+}
+
+void CallGraphVisitor::visit(const koopa_raw_program_t& raw) {
+  assert(raw.funcs.kind == KOOPA_RSIK_FUNCTION);
+  for (int i = 0; i < raw.funcs.len; ++i) {
+    auto ptr = raw.funcs.buffer[i];
+    visit(reinterpret_cast<koopa_raw_function_t>(ptr));
+  }
+}
+
+void CallGraphVisitor::collect_callees(
+    const koopa_raw_function_t& func,
+    std::vector<koopa_raw_function_t>& callees) {
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    for (int j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      if (inst->kind.tag == KOOPA_RVT_CALL) {
+        auto callee = inst->kind.data.call.callee;
+        if (std::find(callees.begin(), callees.end(), callee) ==
+            callees.end()) {
+          callees.push_back(callee);
+        }
+      }
+    }
+  }
+}
+
+void CallGraphVisitor::visit(const koopa_raw_function_t& func) {
+  if (state[func] != State::UNVISITED) {
+    return;
+  }
+  if (func->bbs.len == 0) {  // declaration, we know nothing about it
+    state[func] = State::DONE;
+    clobbers[func] = all_caller_saved();
+    bottom_up_order.push_back(func);
+    return;
+  }
+  state[func] = State::VISITING;
+
+  // visit callees first so that their summaries are ready
+  std::vector<koopa_raw_function_t> callees;
+  collect_callees(func, callees);
+  for (auto& callee : callees) {
+    visit(callee);
+  }
+
+  RegSet regs = {"ra", "t0", "t1", "t2", "t3", "t4", "t5", "t6", "a0"};
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    for (int j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      if (inst->kind.tag != KOOPA_RVT_CALL) {
+        continue;
+      }
+      int arg_count = std::min<int>(inst->kind.data.call.args.len, 8);
+      for (int k = 0; k < arg_count; ++k) {
+        regs.insert("a" + std::to_string(k));
+      }
+      auto& callee = inst->kind.data.call.callee;
+      if (state[callee] != State::DONE) {
+        // recursive call, the callee summary is not available yet
+        regs = all_caller_saved();
+      } else {
+        auto& callee_regs = clobbers[callee];
+        regs.insert(callee_regs.begin(), callee_regs.end());
+      }
+    }
+  }
+  clobbers[func] = regs;
+  state[func] = State::DONE;
+  bottom_up_order.push_back(func);
+}
+
+const CallGraphVisitor::RegSet& CallGraphVisitor::get_clobbers(
+    const koopa_raw_function_t& func) {
+  auto it = clobbers.find(func);
+  if (it == clobbers.end()) {
+    return all_caller_saved();
+  }
+  return it->second;
+}
+
+bool CallGraphVisitor::clobbers_reg(const koopa_raw_function_t& func,
+                                    const std::string& reg) {
+  auto& regs = get_clobbers(func);
+  return regs.find(reg) != regs.end();
+}
+
+};  // namespace KOOPA
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <koopa.h>
+#include "visitor.hpp"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace KOOPA {
+
+/**
+ * interprocedural clobber summaries
+ *
+ * functions are processed bottom-up over the call graph (callees before
+ * callers), and for each function we record the set of caller-saved registers
+ * that a call to it may overwrite. GenASMVisitor uses the summary to keep
+ * values in the untouched caller-saved registers across a call.
+ *
+ * the summary mirrors what GenASMVisitor emits for a function body:
+ * 1. ra and every temporary register handed out by RegPool (t0-t6)
+ * 2. a0 for the return value
+ * 3. a0..a(k-1) for every call with k arguments
+ * 4. the clobbers of every callee
+ * declarations (runtime library functions) and callees that are still being
+ * processed (recursion) are assumed to clobber all caller-saved registers.
+ */
+class CallGraphVisitor : public Visitor {
+ public:
+  using RegSet = std::unordered_set<std::string>;
+
+  // final output
+  std::unordered_map<koopa_raw_function_t, RegSet> clobbers;
+  // functions in bottom-up order (callees first)
+  std::vector<koopa_raw_function_t> bottom_up_order;
+
+  void visit(const koopa_raw_program_t& program) override;
+
+  void visit(const koopa_raw_function_t& func) override;
+
+  const RegSet& get_clobbers(const koopa_raw_function_t& func);
+
+  bool clobbers_reg(const koopa_raw_function_t& func, const std::string& reg);
+
+  static const RegSet& all_caller_saved();
+
+ private:
+  enum class State { UNVISITED, VISITING, DONE };
+  std::unordered_map<koopa_raw_function_t, State> state;
+
+  void collect_callees(const koopa_raw_function_t& func,
+                       std::vector<koopa_raw_function_t>& callees);
+};
+
+};  // namespace KOOPA
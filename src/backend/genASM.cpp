@@ -1,16 +1,22 @@
 #include "genASM.hpp"
 
 #include <cassert>
+#include <sstream>
 #include <string>
+#include <vector>
 
 #include "aggregate.hpp"
 #include "prepareOperand.hpp"
 #include "stack.hpp"
 #include "utils.hpp"
+#include "vector.hpp"
 
 namespace KOOPA {
 
 void GenASMVisitor::visit(const koopa_raw_program_t& raw) {
+  // compute clobber summaries bottom-up over the call graph
+  call_graph.visit(raw);
+
   // 遍历global value
   assert(raw.values.kind == KOOPA_RSIK_VALUE);
   for (int i = 0; i < raw.values.len; ++i) {
@@ -24,6 +30,10 @@ void GenASMVisitor::visit(const koopa_raw_program_t& raw) {
     auto ptr = raw.funcs.buffer[i];
     visit(reinterpret_cast<koopa_raw_function_t>(ptr));
   }
+
+  if (!profile_generate.empty()) {
+    code_stream << gen_profile_runtime(profile_keys, profile_generate);
+  }
 }
 
 void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
@@ -40,31 +50,47 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
       break;
     }
     case KOOPA_RVT_GLOBAL_ALLOC: {
-      code_stream << "  .data" << std::endl;
+      /**
+       * 1. collect the initial words, empty if all of them are zero
+       * 2. zeroed globals go to .bss (no space in the object file), the
+       *    others to .data, or to .sbss / .sdata if they are small
+       */
+      auto& init = kind.data.global_alloc.init;
+      assert(raw_value->ty->tag == KOOPA_RTT_POINTER);
+      int size = get_type_width(raw_value->ty->data.pointer.base);
+      std::vector<int> init_values;
+      if (init->kind.tag == KOOPA_RVT_INTEGER) {
+        init_values.push_back(init->kind.data.integer.value);
+      } else if (init->kind.tag == KOOPA_RVT_AGGREGATE) {
+        AggregateVisitor aggregate_visitor;
+        aggregate_visitor.visit(init->kind.data.aggregate);
+        init_values = aggregate_visitor.init_values;
+      } else {
+        assert(init->kind.tag == KOOPA_RVT_ZERO_INIT);
+      }
+      // trailing zeros are covered by .zero
+      while (!init_values.empty() && init_values.back() == 0) {
+        init_values.pop_back();
+      }
+
+      bool small = is_small_global(raw_value);
+      if (init_values.empty()) {
+        code_stream << (small ? "  .section .sbss,\"aw\",@nobits" : "  .bss")
+                    << std::endl;
+      } else {
+        code_stream << (small ? "  .section .sdata,\"aw\"" : "  .data")
+                    << std::endl;
+      }
+      code_stream << "  .align 2" << std::endl;
       code_stream << "  .global " + std::string(raw_value->name).substr(1)
                   << std::endl;
       code_stream << std::string(raw_value->name).substr(1) + ":" << std::endl;
-      if (kind.data.global_alloc.init->kind.tag == KOOPA_RVT_ZERO_INIT) {
-        assert(raw_value->ty->tag == KOOPA_RTT_POINTER);
-        // assert(raw_value->ty->data.pointer.base->tag == KOOPA_RTT_INT32);
-        int zero_size = get_type_width(raw_value->ty->data.pointer.base);
+      for (auto value : init_values) {
+        code_stream << "  .word " + std::to_string(value) << std::endl;
+      }
+      int zero_size = size - 4 * (int)init_values.size();
+      if (zero_size > 0) {
         code_stream << "  .zero " + std::to_string(zero_size) << std::endl;
-      } else if (kind.data.global_alloc.init->kind.tag == KOOPA_RVT_INTEGER) {
-        code_stream << "  .word " +
-                           std::to_string(kind.data.global_alloc.init->kind.data
-                                              .integer.value)
-                    << std::endl;
-      } else if (kind.data.global_alloc.init->kind.tag == KOOPA_RVT_AGGREGATE) {
-        AggregateVisitor aggregate_visitor;
-        aggregate_visitor.visit(
-            kind.data.global_alloc.init->kind.data.aggregate);
-        auto& init_values = aggregate_visitor.init_values;
-        for (int i = 0; i < init_values.size(); ++i) {
-          code_stream << "  .word " + std::to_string(init_values[i])
-                      << std::endl;
-        }
-      } else {
-        assert(0);
       }
       break;
     }
@@ -78,6 +104,23 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
       auto& src = raw_value->kind.data.load.src;
       assert(src->ty->tag == KOOPA_RTT_POINTER);
       // assert(src->ty->data.pointer.base->tag == KOOPA_RTT_INT32);
+
+      // the value is still known from an earlier load / store of this block
+      auto known = memory_state.lookup(src);
+      if (known && func_stack.find(known)) {
+        func_stack.share(raw_value, known);
+        alias_analysis.set_equivalent(raw_value, known);
+        break;
+      }
+      if (known && known->kind.tag == KOOPA_RVT_INTEGER) {
+        auto load_reg_name = reg_pool.getReg();
+        code_stream << "  li " + load_reg_name + ", " +
+                           std::to_string(known->kind.data.integer.value)
+                    << std::endl;
+        store_func_stack(raw_value, load_reg_name);
+        reg_pool.freeReg(load_reg_name);
+        break;
+      }
       /**
        * lw t0, offset(sp)
        */
@@ -102,6 +145,13 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
           code_stream << "  lw " + load_reg_name + ", 0(" + load_reg_name + ")"
                       << std::endl;
         }
+      } else if (is_small_global(src)) {
+        auto sym = std::string(src->name).substr(1);
+        code_stream << "  lui " + load_reg_name + ", %hi(" + sym + ")"
+                    << std::endl;
+        code_stream << "  lw " + load_reg_name + ", %lo(" + sym + ")(" +
+                           load_reg_name + ")"
+                    << std::endl;
       } else if (src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
         code_stream << "  la " + load_reg_name + ", " +
                            std::string(src->name).substr(1)
@@ -112,12 +162,17 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
         assert(0);
       }
       store_func_stack(raw_value, load_reg_name);
+      memory_state.record_load(src, raw_value);
 
       reg_pool.freeReg(load_reg_name);
       break;
     }
     case KOOPA_RVT_STORE: {
+      if (dead_stores.count(raw_value)) {
+        break;
+      }
       visit(kind.data.store);
+      memory_state.record_store(kind.data.store.dest, kind.data.store.value);
       break;
     }
     case KOOPA_RVT_GET_PTR: {
@@ -295,6 +350,60 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
       auto lhs = kind.data.binary.lhs;
       auto rhs = kind.data.binary.rhs;
 
+      /**
+       * use what the range analysis knows
+       * 1. the result is a constant (e.g. a comparison that always holds)
+       * 2. x % c is x itself if 0 <= x < c
+       * 3. for x >= 0, x / 2^k is a shift and x % 2^k a mask
+       */
+      auto range = ranges.get_range(raw_value);
+      auto lhs_range = ranges.get_range(lhs);
+      auto rhs_range = ranges.get_range(rhs);
+      if (range.is_constant()) {
+        auto reg = reg_pool.getReg();
+        code_stream << "  li " + reg + ", " + std::to_string(range.lo)
+                    << std::endl;
+        store_func_stack(raw_value, reg);
+        reg_pool.freeReg(reg);
+        break;
+      }
+      if (op == KOOPA_RBO_MOD && lhs_range.non_negative() &&
+          rhs_range.lo > lhs_range.hi && func_stack.find(lhs)) {
+        func_stack.share(raw_value, lhs);
+        break;
+      }
+      int shift = 0;
+      if (rhs->kind.tag == KOOPA_RVT_INTEGER) {
+        int divisor = rhs->kind.data.integer.value;
+        while (divisor > 1 && divisor % 2 == 0) {
+          divisor /= 2;
+          shift += 1;
+        }
+        shift = divisor == 1 ? shift : 0;
+      }
+      if ((op == KOOPA_RBO_DIV || op == KOOPA_RBO_MOD) && shift > 0 &&
+          lhs_range.non_negative()) {
+        auto dividend = PrepareOperandVisitor(&func_stack, &reg_pool);
+        dividend.set_load_reg_name("t0");
+        dividend.visit(lhs);
+        code_stream << dividend.asm_code;
+        int mask = rhs->kind.data.integer.value - 1;
+        if (op == KOOPA_RBO_DIV) {
+          code_stream << "  srai t0, t0, " + std::to_string(shift)
+                      << std::endl;
+        } else if (mask < 2048) {
+          code_stream << "  andi t0, t0, " + std::to_string(mask) << std::endl;
+        } else {
+          auto mask_reg = reg_pool.getReg();
+          code_stream << "  li " + mask_reg + ", " + std::to_string(mask)
+                      << std::endl;
+          code_stream << "  and t0, t0, " + mask_reg << std::endl;
+          reg_pool.freeReg(mask_reg);
+        }
+        store_func_stack(raw_value, "t0");
+        break;
+      }
+
       auto op_1_visitor = PrepareOperandVisitor(&func_stack, &reg_pool);
       op_1_visitor.set_load_reg_name("t0");
       op_1_visitor.visit(lhs);
@@ -389,38 +498,44 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
       break;
     }
     case KOOPA_RVT_BRANCH: {
-      auto prepareOperand = PrepareOperandVisitor(&func_stack, &reg_pool);
-      prepareOperand.visit(kind.data.branch.cond);
-      code_stream << prepareOperand.asm_code;
-      auto& load_reg_name = prepareOperand.load_reg_name;
-
-      // code_stream << "  bnez " + load_reg_name + ", " +
-      // std::string(kind.data.branch.true_bb->name).substr(1) << std::endl;
-      // code_stream << "  j " +
-      // std::string(kind.data.branch.false_bb->name).substr(1) << std::endl;
-
-      // TODO: this way has relatively low performence.
-      auto skip_label =
-          std::string(kind.data.branch.true_bb->name).substr(1) + "_skip";
-      // since we have traverse all basic block when visiting raw function
-      // we don't need to deal with the true_bb and false_bb here
-      code_stream
-          << "  bnez " + load_reg_name + ", " +
-                 //  std::string(kind.data.branch.true_bb->name).substr(1)
-                 skip_label
-          << std::endl;
-      code_stream << "  j " +
-                         std::string(kind.data.branch.false_bb->name).substr(1)
-                  << std::endl;
+      // the 12-bit offset of bnez/beqz may not reach the target, so the
+      // conditional branch only skips over an unconditional j. when one of
+      // the targets is the next block we fall through to it instead of
+      // emitting a second j. the values hoisted into a target are placed
+      // on its own edge, after the condition register is released.
+      auto& true_bb = kind.data.branch.true_bb;
+      auto& false_bb = kind.data.branch.false_bb;
+      if (auto chain = switches.chain_at(cur_bb)) {
+        gen_switch(*chain);
+        break;
+      }
+      // the range analysis knows which way it goes
+      auto cond_range = ranges.get_range(kind.data.branch.cond);
+      if (cond_range.lo > 0 || cond_range.hi < 0 ||
+          (cond_range.is_constant() && cond_range.lo == 0)) {
+        gen_jump(cond_range.lo == 0 ? false_bb : true_bb, true);
+        break;
+      }
+      auto& first = false_bb == next_bb ? true_bb : false_bb;
+      auto& second = false_bb == next_bb ? false_bb : true_bb;
+      auto skip_label = std::string(true_bb->name).substr(1) + "_skip_" +
+                        std::to_string(skip_label_counter++);
+      {
+        auto prepareOperand = PrepareOperandVisitor(&func_stack, &reg_pool);
+        prepareOperand.visit(kind.data.branch.cond);
+        code_stream << prepareOperand.asm_code;
+        auto& load_reg_name = prepareOperand.load_reg_name;
+        code_stream << (false_bb == next_bb ? "  beqz " : "  bnez ") +
+                           load_reg_name + ", " + skip_label
+                    << std::endl;
+      }
+      gen_jump(first, false);
       code_stream << skip_label + ":" << std::endl;
-      code_stream << "  j " +
-                         std::string(kind.data.branch.true_bb->name).substr(1)
-                  << std::endl;
+      gen_jump(second, true);
       break;
     }
     case KOOPA_RVT_JUMP: {
-      code_stream << "  j " + std::string(kind.data.jump.target->name).substr(1)
-                  << std::endl;
+      gen_jump(kind.data.jump.target, true);
       break;
     }
     case KOOPA_RVT_CALL: {
@@ -433,12 +548,21 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
       int param_count = kind.data.call.args.len;
       int i = 0;
       for (; i < param_count && i < 8; ++i) {  // first 8 params
+        auto arg =
+            reinterpret_cast<koopa_raw_value_t>(kind.data.call.args.buffer[i]);
+        auto arg_reg_name = "a" + std::to_string(i);
+        // still there since an earlier call in this basic block
+        if (arg_reg_holds(arg_reg_name, arg)) {
+          continue;
+        }
         auto prepareOperandVisitor =
             PrepareOperandVisitor(&func_stack, &reg_pool);
-        prepareOperandVisitor.set_load_reg_name("a" + std::to_string(i));
-        prepareOperandVisitor.visit(
-            reinterpret_cast<koopa_raw_value_t>(kind.data.call.args.buffer[i]));
+        prepareOperandVisitor.set_load_reg_name(arg_reg_name);
+        prepareOperandVisitor.visit(arg);
         code_stream << prepareOperandVisitor.asm_code;
+        if (arg->kind.tag != KOOPA_RVT_FUNC_ARG_REF) {
+          arg_reg_values[arg_reg_name] = arg;
+        }
       }
       for (; i < param_count; ++i) {  // more than 8 params
         auto prepareOperandVisitor =
@@ -467,6 +591,15 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
       code_stream << "  call " +
                          std::string(kind.data.call.callee->name).substr(1)
                   << std::endl;
+      memory_state.record_call();
+      // only forget the argument registers the callee may overwrite
+      for (auto it = arg_reg_values.begin(); it != arg_reg_values.end();) {
+        if (call_graph.clobbers_reg(kind.data.call.callee, it->first)) {
+          it = arg_reg_values.erase(it);
+        } else {
+          ++it;
+        }
+      }
       if (kind.data.call.callee->ty->data.function.ret->tag != KOOPA_RTT_UNIT) {
         assert(kind.data.call.callee->ty->data.function.ret->tag ==
                KOOPA_RTT_INT32);
@@ -487,6 +620,7 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
         // }
 
         store_func_stack(raw_value, "a0");
+        arg_reg_values["a0"] = raw_value;
       }
       break;
     }
@@ -502,15 +636,38 @@ void GenASMVisitor::visit(const koopa_raw_value_t& raw_value) {
 }
 
 void GenASMVisitor::visit(const koopa_raw_function_t& raw_func) {
-  if (raw_func->bbs.len == 0) {  // pass declaration
+  auto func_name = std::string(raw_func->name).substr(1);
+  if (raw_func->bbs.len == 0) {
+    // pass declaration, except for the vector helpers we provide ourselves
+    auto helper = gen_vector_helper(func_name);
+    if (!helper.empty()) {
+      code_stream << "  .text" << std::endl;
+      code_stream << "  .global " + func_name << std::endl;
+      code_stream << func_name + ":" << std::endl;
+      code_stream << helper;
+    }
     return;
   }
-  auto func_name = std::string(raw_func->name).substr(1);
   auto stack_calculator = StackCalculatorVisitor();
   stack_calculator.visit(raw_func);
   int stack_size = stack_calculator.stack_size;
   assert(stack_size % 16 == 0);
   func_stack.reset(stack_size);
+  alias_analysis.run(raw_func);
+  ranges.run(raw_func);
+  redundancy.run(raw_func);
+  sinking.run(raw_func);
+  profile.run(raw_func);
+  // instrumented code counts the edges of the raw program, so it has to
+  // take every one of them
+  if (profile_generate.empty()) {
+    switches.run(raw_func);
+  } else {
+    switches.reset();
+  }
+  placement.run(raw_func);
+  placed_edges.clear();
+  cur_func = raw_func;
 
   // start to generate asm code
   code_stream << "  .text" << std::endl;
@@ -536,23 +693,86 @@ void GenASMVisitor::visit(const koopa_raw_function_t& raw_func) {
       code_stream << "  sw ra, 0(t0)" << std::endl;
     }
   }
+  if (!profile_generate.empty()) {
+    gen_counter(nullptr, reinterpret_cast<koopa_raw_basic_block_t>(
+                             raw_func->bbs.buffer[0]));
+  }
 
+  /**
+   * 1. the block each one falls through to, cold blocks go to a section of
+   *    their own and nothing falls through into it
+   * 2. the stack slots are handed out as the blocks are generated, in the
+   *    order of the raw program (a value is defined before it is used), so
+   *    each block is generated into a buffer of its own
+   * 3. write the buffers in the order of the placement
+   */
+  auto& blocks = placement.get_order();
+  std::unordered_map<koopa_raw_basic_block_t, koopa_raw_basic_block_t>
+      placed_next;
+  for (int i = 0; i + 1 < (int)blocks.size(); ++i) {
+    if (placement.is_cold(blocks[i]) == placement.is_cold(blocks[i + 1])) {
+      placed_next[blocks[i]] = blocks[i + 1];
+    }
+  }
+  std::unordered_map<koopa_raw_basic_block_t, std::string> block_code;
   for (int i = 0; i < raw_func->bbs.len; ++i) {
-    auto ptr = raw_func->bbs.buffer[i];
-    visit(reinterpret_cast<koopa_raw_basic_block_t>(ptr));
+    auto bb =
+        reinterpret_cast<koopa_raw_basic_block_t>(raw_func->bbs.buffer[i]);
+    if (switches.is_folded(bb)) {
+      continue;
+    }
+    std::ostringstream buffer;
+    auto file = code_stream.std::ios::rdbuf(buffer.rdbuf());
+    next_bb = placed_next.count(bb) ? placed_next[bb] : nullptr;
+    visit(bb);
+    code_stream.std::ios::rdbuf(file);
+    block_code[bb] = buffer.str();
+  }
+  for (int i = 0; i < (int)blocks.size(); ++i) {
+    if (placement.is_cold(blocks[i]) &&
+        (i == 0 || !placement.is_cold(blocks[i - 1]))) {
+      code_stream << "  .section .text.unlikely,\"ax\",@progbits"
+                  << std::endl;
+    }
+    code_stream << block_code[blocks[i]];
   }
+  code_stream << rodata;
+  rodata.clear();
 }
 
 void GenASMVisitor::visit(const koopa_raw_basic_block_t& raw_bb) {
+  // control may reach this block from anywhere
+  arg_reg_values.clear();
+  memory_state.reset();
+  dead_stores = memory_state.find_dead_stores(raw_bb);
   if (raw_bb->name) {
     // TODO: this way is pretty hacky
     code_stream << std::string(raw_bb->name).substr(1) + ":" << std::endl;
   }
   // visit all the instructions
   assert(raw_bb->insts.kind == KOOPA_RSIK_VALUE);
+  cur_bb = raw_bb;
+  for (auto& inst : sinking.sunk_into(raw_bb)) {
+    visit(inst);
+  }
   for (int i = 0; i < raw_bb->insts.len; ++i) {
-    auto ptr = raw_bb->insts.buffer[i];
-    visit(reinterpret_cast<koopa_raw_value_t>(ptr));
+    auto inst = reinterpret_cast<koopa_raw_value_t>(raw_bb->insts.buffer[i]);
+    if (sinking.is_sunk(inst)) {
+      continue;
+    }
+    // already in its slot, placed on every edge into this block
+    int edges = redundancy.hoisted_edges(inst);
+    if (edges > 0 && placed_edges[inst] == edges) {
+      continue;
+    }
+    // computed before on every path
+    auto same = redundancy.equivalent(inst);
+    if (same && func_stack.find(same)) {
+      func_stack.share(inst, same);
+      alias_analysis.set_equivalent(inst, same);
+      continue;
+    }
+    visit(inst);
   }
 }
 
@@ -627,14 +847,22 @@ void GenASMVisitor::visit(const koopa_raw_store_t& store) {
      * global @a_1 = alloc i32, 10
      * store %1, @a_1
      * ===============
-     * la t1, a_1
-     * sw t0, 0(t1)
+     * lui t1, %hi(a_1)
+     * sw t0, %lo(a_1)(t1)
+     * (la t1, a_1 + sw t0, 0(t1) if it is not small data)
      */
     auto tmp_reg_1 = reg_pool.getReg();
-    code_stream << "  la " + tmp_reg_1 + ", " +
-                       std::string(store.dest->name).substr(1)
-                << std::endl;
-    code_stream << "  sw " + tmp_reg_0 + ", 0(" + tmp_reg_1 + ")" << std::endl;
+    auto sym = std::string(store.dest->name).substr(1);
+    if (is_small_global(store.dest)) {
+      code_stream << "  lui " + tmp_reg_1 + ", %hi(" + sym + ")" << std::endl;
+      code_stream << "  sw " + tmp_reg_0 + ", %lo(" + sym + ")(" + tmp_reg_1 +
+                         ")"
+                  << std::endl;
+    } else {
+      code_stream << "  la " + tmp_reg_1 + ", " + sym << std::endl;
+      code_stream << "  sw " + tmp_reg_0 + ", 0(" + tmp_reg_1 + ")"
+                  << std::endl;
+    }
     reg_pool.freeReg(tmp_reg_1);
 
   } else {
@@ -650,6 +878,7 @@ void GenASMVisitor::visit(const koopa_raw_return_t& ret) {
     prepareOperandVisitor.set_load_reg_name("a0");
     prepareOperandVisitor.visit(ret.value);
     code_stream << prepareOperandVisitor.asm_code;
+    arg_reg_values.erase("a0");
     // std::cout<<"ret value kind tag: "<<ret.value->kind.tag<<std::endl;
     // if(ret.value->kind.tag == KOOPA_RVT_GET_ELEM_PTR || ret.value->kind.tag
     // == KOOPA_RVT_GET_PTR) {
@@ -680,6 +909,285 @@ void GenASMVisitor::visit(const koopa_raw_return_t& ret) {
   code_stream << "  ret" << std::endl;
 }
 
+/**
+ * place the values hoisted into target on the edge from the current block
+ * 1. copy the value from the slot of its source, or
+ * 2. compute it here if its operands are ready: in a slot already, or
+ *    hoisted values placed earlier on this edge
+ * a value missing on one edge is computed in target as before
+ */
+void GenASMVisitor::gen_edge_moves(const koopa_raw_basic_block_t& target) {
+  auto& moves = redundancy.edge_moves(cur_bb, target);
+  if (moves.empty()) {
+    return;
+  }
+  // loads here must go to memory, the state of the block may not hold on
+  // the other edge
+  memory_state.reset();
+  std::unordered_set<koopa_raw_value_t> placed;
+  auto ready = [&](const koopa_raw_value_t& op) {
+    if (redundancy.hoisted_from(op) == target) {
+      return placed.count(op) > 0;
+    }
+    return op->kind.tag == KOOPA_RVT_INTEGER ||
+           op->kind.tag == KOOPA_RVT_GLOBAL_ALLOC || func_stack.find(op);
+  };
+  for (auto& move : moves) {
+    auto& value = move.value;
+    if (move.source && func_stack.find(move.source)) {
+      auto copy = PrepareOperandVisitor(&func_stack, &reg_pool);
+      copy.visit(move.source);
+      code_stream << copy.asm_code;
+      store_func_stack(value, copy.load_reg_name);
+    } else {
+      bool operands_ready = true;
+      switch (value->kind.tag) {
+        case KOOPA_RVT_BINARY: {
+          operands_ready = ready(value->kind.data.binary.lhs) &&
+                           ready(value->kind.data.binary.rhs);
+          break;
+        }
+        case KOOPA_RVT_GET_ELEM_PTR: {
+          operands_ready = ready(value->kind.data.get_elem_ptr.src) &&
+                           ready(value->kind.data.get_elem_ptr.index);
+          break;
+        }
+        case KOOPA_RVT_GET_PTR: {
+          operands_ready = ready(value->kind.data.get_ptr.src) &&
+                           ready(value->kind.data.get_ptr.index);
+          break;
+        }
+        default: {
+          operands_ready = ready(value->kind.data.load.src);
+          break;
+        }
+      }
+      if (!operands_ready) {
+        continue;
+      }
+      visit(value);
+    }
+    placed.insert(value);
+    placed_edges[value] += 1;
+  }
+  memory_state.reset();
+}
+
+/**
+ * leave the current block for target: place the values hoisted into it,
+ * thread the edge if possible, and jump unless the next block is where
+ * control goes anyway (only if fall_through, i.e. nothing else follows)
+ */
+void GenASMVisitor::gen_jump(const koopa_raw_basic_block_t& target,
+                             bool fall_through) {
+  gen_edge_moves(target);
+  if (!profile_generate.empty()) {
+    gen_counter(cur_bb, target);
+  }
+  auto dest = thread_edge(target);
+  if (!profile_generate.empty() && dest != target) {
+    gen_counter(target, dest);
+  }
+  if (!fall_through || dest != next_bb) {
+    code_stream << "  j " + std::string(dest->name).substr(1) << std::endl;
+  }
+}
+
+/**
+ * -fprofile-generate: count the edge from -> to of the current function
+ * (the calls of it if from is nullptr) in the next word of
+ * __profile_counts, see gen_profile_runtime
+ */
+void GenASMVisitor::gen_counter(const koopa_raw_basic_block_t& from,
+                                const koopa_raw_basic_block_t& to) {
+  int offset = 4 * profile_keys.size();
+  profile_keys.push_back(profile_key(cur_func, from, to));
+  auto base_reg = reg_pool.getReg();
+  auto count_reg = reg_pool.getReg();
+  code_stream << "  la " + base_reg + ", __profile_counts" << std::endl;
+  if (offset >= 2048) {
+    code_stream << "  li " + count_reg + ", " + std::to_string(offset)
+                << std::endl;
+    code_stream << "  add " + base_reg + ", " + base_reg + ", " + count_reg
+                << std::endl;
+    offset = 0;
+  }
+  auto slot = std::to_string(offset) + "(" + base_reg + ")";
+  code_stream << "  lw " + count_reg + ", " + slot << std::endl;
+  code_stream << "  addi " + count_reg + ", " + count_reg + ", 1" << std::endl;
+  code_stream << "  sw " + count_reg + ", " + slot << std::endl;
+  reg_pool.freeReg(count_reg);
+  reg_pool.freeReg(base_reg);
+}
+
+/**
+ * jump threading: if the branch ending target is known on the edge from
+ * the current block (see RangeAnalysis::known_target), run a copy of
+ * target here and go straight to the block it branches to. target has to
+ * be small and plain: loads, stores and binary ops that no other pass
+ * moved, shared or placed on an edge. gives the block to jump to.
+ */
+koopa_raw_basic_block_t GenASMVisitor::thread_edge(
+    const koopa_raw_basic_block_t& target) {
+  const int max_insts = 8;
+  if (target == cur_bb || target->insts.len > max_insts ||
+      switches.chain_at(target) ||
+      !sinking.sunk_into(target).empty() ||
+      !redundancy.edge_moves(cur_bb, target).empty()) {
+    return target;
+  }
+  // never taken in the training run, the copy would only cost space
+  if (profile.available() && profile.edge_count(cur_bb, target) == 0) {
+    return target;
+  }
+  auto dest = ranges.known_target(cur_bb, target);
+  if (dest == nullptr || dest == target ||
+      !redundancy.edge_moves(target, dest).empty()) {
+    return target;
+  }
+  // a branch known on every edge is a plain jump already
+  auto term = reinterpret_cast<koopa_raw_value_t>(
+      target->insts.buffer[target->insts.len - 1]);
+  auto cond_range = ranges.get_range(term->kind.data.branch.cond);
+  if (cond_range.lo > 0 || cond_range.hi < 0 || cond_range.is_constant()) {
+    return target;
+  }
+  for (int i = 0; i < target->insts.len - 1; ++i) {
+    auto inst = reinterpret_cast<koopa_raw_value_t>(target->insts.buffer[i]);
+    auto tag = inst->kind.tag;
+    if ((tag != KOOPA_RVT_LOAD && tag != KOOPA_RVT_STORE &&
+         tag != KOOPA_RVT_BINARY) ||
+        sinking.is_sunk(inst) || redundancy.equivalent(inst) ||
+        redundancy.hoisted_from(inst)) {
+      return target;
+    }
+  }
+  // the copy starts from what this block knows about memory, not target
+  memory_state.reset();
+  for (int i = 0; i < target->insts.len - 1; ++i) {
+    visit(reinterpret_cast<koopa_raw_value_t>(target->insts.buffer[i]));
+  }
+  memory_state.reset();
+  return dest;
+}
+
+/**
+ * the multiway branch ending the head of chain
+ * 1. dense constants: a jump table in .rodata, indexed by the key minus
+ *    the smallest constant. anything outside goes to the default.
+ * 2. sparse ones: a binary search over the sorted constants
+ * every target is reached with a j, conditional branches stay inside the
+ * dispatch code where their 12-bit offsets reach.
+ */
+void GenASMVisitor::gen_switch(const SwitchChain& chain) {
+  auto key = PrepareOperandVisitor(&func_stack, &reg_pool);
+  key.visit(chain.key);
+  code_stream << key.asm_code;
+  auto& key_reg = key.load_reg_name;
+  auto scratch = reg_pool.getReg();
+  auto label = std::string(cur_bb->name).substr(1) + "_switch_" +
+               std::to_string(skip_label_counter++);
+  auto default_name = std::string(chain.default_bb->name).substr(1);
+
+  auto& cases = chain.cases;
+  std::int64_t min = cases.front().first;
+  std::int64_t span = (std::int64_t)cases.back().first - min + 1;
+  if (span > 3 * (std::int64_t)cases.size()) {
+    gen_search(chain, 0, cases.size() - 1, key_reg, scratch, label);
+    reg_pool.freeReg(scratch);
+    return;
+  }
+
+  auto index = key_reg;
+  if (min != 0) {
+    if (min <= 2048 && min > -2048) {
+      code_stream << "  addi " + scratch + ", " + key_reg + ", " +
+                         std::to_string(-min)
+                  << std::endl;
+    } else {
+      code_stream << "  li " + scratch + ", " + std::to_string(min)
+                  << std::endl;
+      code_stream << "  sub " + scratch + ", " + key_reg + ", " + scratch
+                  << std::endl;
+    }
+    index = scratch;
+  }
+  auto bound = reg_pool.getReg();
+  code_stream << "  li " + bound + ", " + std::to_string(span) << std::endl;
+  code_stream << "  bltu " + index + ", " + bound + ", " + label + "_in"
+              << std::endl;
+  code_stream << "  j " + default_name << std::endl;
+  code_stream << label + "_in:" << std::endl;
+  code_stream << "  slli " + scratch + ", " + index + ", 2" << std::endl;
+  code_stream << "  la " + bound + ", " + label << std::endl;
+  code_stream << "  add " + scratch + ", " + scratch + ", " + bound
+              << std::endl;
+  code_stream << "  lw " + scratch + ", 0(" + scratch + ")" << std::endl;
+  code_stream << "  jr " + scratch << std::endl;
+  reg_pool.freeReg(bound);
+  reg_pool.freeReg(scratch);
+
+  rodata += "  .section .rodata\n  .align 2\n" + label + ":\n";
+  int k = 0;
+  for (std::int64_t value = min; value < min + span; ++value) {
+    auto target = default_name;
+    if (cases[k].first == value) {
+      target = std::string(cases[k++].second->name).substr(1);
+    }
+    rodata += "  .word " + target + "\n";
+  }
+}
+
+// binary search for the key among cases[first..last]
+void GenASMVisitor::gen_search(const SwitchChain& chain, int first, int last,
+                               const std::string& key_reg,
+                               const std::string& scratch,
+                               const std::string& label) {
+  auto& cases = chain.cases;
+  // a few cases are tested one by one
+  if (last - first < 3) {
+    for (int k = first; k <= last; ++k) {
+      auto next_label = label + "_" + std::to_string(k);
+      code_stream << "  li " + scratch + ", " +
+                         std::to_string(cases[k].first)
+                  << std::endl;
+      code_stream << "  bne " + key_reg + ", " + scratch + ", " + next_label
+                  << std::endl;
+      code_stream << "  j " + std::string(cases[k].second->name).substr(1)
+                  << std::endl;
+      code_stream << next_label + ":" << std::endl;
+    }
+    code_stream << "  j " + std::string(chain.default_bb->name).substr(1)
+                << std::endl;
+    return;
+  }
+  int mid = (first + last + 1) / 2;
+  auto left_label = label + "_lt_" + std::to_string(mid);
+  code_stream << "  li " + scratch + ", " + std::to_string(cases[mid].first)
+              << std::endl;
+  code_stream << "  blt " + key_reg + ", " + scratch + ", " + left_label
+              << std::endl;
+  gen_search(chain, mid, last, key_reg, scratch, label);
+  code_stream << left_label + ":" << std::endl;
+  gen_search(chain, first, mid - 1, key_reg, scratch, label);
+}
+
+bool GenASMVisitor::arg_reg_holds(const std::string& reg_name,
+                                  const koopa_raw_value_t& value) {
+  auto it = arg_reg_values.find(reg_name);
+  if (it == arg_reg_values.end()) {
+    return false;
+  }
+  auto& held = it->second;
+  if (held == value) {
+    return true;
+  }
+  // integers are separate values for each use
+  return held->kind.tag == KOOPA_RVT_INTEGER &&
+         value->kind.tag == KOOPA_RVT_INTEGER &&
+         held->kind.data.integer.value == value->kind.data.integer.value;
+}
+
 void GenASMVisitor::store_func_stack(const koopa_raw_value_t& value,
                                      std::string reg_name) {
   // assert(func_stack.find(value));
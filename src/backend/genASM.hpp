@@ -5,8 +5,18 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include "regpool.hpp"
 #include "stack.hpp"
+#include "callgraph.hpp"
+#include "alias.hpp"
+#include "memstate.hpp"
+#include "placement.hpp"
+#include "pre.hpp"
+#include "profile.hpp"
+#include "range.hpp"
+#include "sink.hpp"
+#include "switch.hpp"
 #include <fstream>
 
 namespace KOOPA {
@@ -19,10 +29,62 @@ class GenASMVisitor : public Visitor {
 
   RegPool reg_pool;
 
+  CallGraphVisitor call_graph;
+
+  // alias analysis of the function being generated
+  AliasAnalysis alias_analysis;
+
+  // memory contents known within the current basic block
+  MemoryState memory_state;
+  // stores of the current basic block that are overwritten before any read
+  std::unordered_set<koopa_raw_value_t> dead_stores;
+  // the values the integers of the function may take
+  RangeAnalysis ranges;
+  // redundant and partially redundant expressions of the function
+  RedundancyElimination redundancy;
+  // the number of incoming edges a hoisted value was placed on so far
+  std::unordered_map<koopa_raw_value_t, int> placed_edges;
+  // instructions moved into the blocks using them
+  CodeSinking sinking;
+  // the edge counts of -fprofile-use, if any
+  Profile profile;
+  // where instrumented code writes its counts, empty if not instrumenting
+  std::string profile_generate;
+  // the counters emitted so far, by position in __profile_counts
+  std::vector<std::string> profile_keys;
+  // if-else chains testing one variable, lowered to a multiway branch
+  SwitchLowering switches;
+  // the order the blocks of the current function are emitted in
+  BlockPlacement placement;
+  // the jump tables of the current function, emitted after its code
+  std::string rodata;
+
+  /**
+   * the value currently held by each argument register (a0-a7)
+   * only call and ret lowering write these registers, so within a basic
+   * block we know exactly what they hold. a call only invalidates the
+   * registers in the callee's clobber summary.
+   */
+  std::unordered_map<std::string, koopa_raw_value_t> arg_reg_values;
+
+  // several branches may share a target, so every skip label gets a suffix
+  int skip_label_counter = 0;
+
+  // the block emitted right after the current one (fall-through target)
+  koopa_raw_basic_block_t next_bb = nullptr;
+  koopa_raw_basic_block_t cur_bb = nullptr;
+  koopa_raw_function_t cur_func = nullptr;
+
   GenASMVisitor(const std::string& output_file)
       : code_stream(output_file, std::ios::out | std::ios::trunc),
         func_stack(16),
-        reg_pool(7) {
+        reg_pool(7),
+        memory_state(&alias_analysis),
+        ranges(&alias_analysis),
+        redundancy(&alias_analysis),
+        sinking(&alias_analysis, &redundancy),
+        switches(&redundancy, &sinking, &profile),
+        placement(&profile, &switches) {
     if (!code_stream.is_open()) {
       throw std::runtime_error("Failed to open output file");
     }
@@ -32,6 +94,18 @@ class GenASMVisitor : public Visitor {
 
   void store_func_stack(const koopa_raw_value_t& value, std::string reg_name);
 
+  bool arg_reg_holds(const std::string& reg_name,
+                     const koopa_raw_value_t& value);
+  void gen_edge_moves(const koopa_raw_basic_block_t& target);
+  void gen_jump(const koopa_raw_basic_block_t& target, bool fall_through);
+  void gen_counter(const koopa_raw_basic_block_t& from,
+                   const koopa_raw_basic_block_t& to);
+  koopa_raw_basic_block_t thread_edge(const koopa_raw_basic_block_t& target);
+  void gen_switch(const SwitchChain& chain);
+  void gen_search(const SwitchChain& chain, int first, int last,
+                  const std::string& key_reg, const std::string& scratch,
+                  const std::string& label);
+
   void visit(const koopa_raw_program_t& program) override;
   void visit(const koopa_raw_value_t& value) override;
   void visit(const koopa_raw_function_t& func) override;
@@ -4,7 +4,9 @@
 #include "genASM.hpp"
 #include <fstream>
 
-void IR_to_ASM(std::unique_ptr<std::string>& ir, const std::string& file_name) {
+void IR_to_ASM(std::unique_ptr<std::string>& ir, const std::string& file_name,
+               const std::string& profile_generate = "",
+               const std::string& profile_use = "") {
   // ir to raw program
   koopa_program_t program;
   koopa_error_code_t ret = koopa_parse_from_string(ir->c_str(), &program);
@@ -18,6 +20,11 @@ void IR_to_ASM(std::unique_ptr<std::string>& ir, const std::string& file_name) {
 
   // generate asm
   KOOPA::GenASMVisitor gen_asm_visitor(file_name);
+  gen_asm_visitor.profile_generate = profile_generate;
+  if (!profile_use.empty() && !gen_asm_visitor.profile.load(profile_use)) {
+    std::cout << "cannot read profile " << profile_use << ", ignored"
+              << std::endl;
+  }
   gen_asm_visitor.visit(raw);
 
   // 处理完成, 释放 raw program builder 占用的内存
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <koopa.h>
+#include "alias.hpp"
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace KOOPA {
+
+/**
+ * the values known to be in memory at the current point of a basic block
+ *
+ * every entry (ptr, value) says that *ptr holds value, where value is an
+ * integer or an instruction whose stack slot holds it. a store records its
+ * value, a load its result, and entries are dropped when a store or a call
+ * may overwrite them (see AliasAnalysis). a later load of a must-alias
+ * pointer can then reuse the value instead of going to memory.
+ *
+ * the state starts empty at every block, control may reach it from anywhere
+ */
+class MemoryState {
+ public:
+  explicit MemoryState(AliasAnalysis* _alias_analysis)
+      : alias_analysis(_alias_analysis) {}
+
+  void reset() { entries.clear(); }
+
+  // the value *ptr is known to hold, nullptr if unknown
+  koopa_raw_value_t lookup(const koopa_raw_value_t& ptr) {
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+      if (alias_analysis->alias(it->first, ptr) == AliasResult::MUST_ALIAS) {
+        return it->second;
+      }
+    }
+    return nullptr;
+  }
+
+  void record_load(const koopa_raw_value_t& ptr,
+                   const koopa_raw_value_t& value) {
+    entries.push_back({ptr, value});
+  }
+
+  void record_store(const koopa_raw_value_t& ptr,
+                    const koopa_raw_value_t& value) {
+    erase_if([&](const koopa_raw_value_t& other) {
+      return alias_analysis->alias(other, ptr) != AliasResult::NO_ALIAS;
+    });
+    entries.push_back({ptr, value});
+  }
+
+  void record_call() {
+    erase_if([&](const koopa_raw_value_t& other) {
+      return alias_analysis->call_may_access(other);
+    });
+  }
+
+  /**
+   * dead store elimination within bb
+   * a store is dead if a later store of the block overwrites the same
+   * location before anything may read it (a load that may alias it, or a
+   * call that may access it)
+   */
+  std::unordered_set<koopa_raw_value_t> find_dead_stores(
+      const koopa_raw_basic_block_t& bb) {
+    std::unordered_set<koopa_raw_value_t> dead;
+    // stores whose value may still be read
+    std::vector<koopa_raw_value_t> pending;
+    auto drop = [&](auto pred) {
+      std::vector<koopa_raw_value_t> kept;
+      for (auto& store : pending) {
+        if (!pred(store->kind.data.store.dest)) {
+          kept.push_back(store);
+        }
+      }
+      pending.swap(kept);
+    };
+    for (int i = 0; i < bb->insts.len; ++i) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+      if (inst->kind.tag == KOOPA_RVT_STORE) {
+        auto& dest = inst->kind.data.store.dest;
+        for (auto& store : pending) {
+          if (alias_analysis->alias(store->kind.data.store.dest, dest) ==
+              AliasResult::MUST_ALIAS) {
+            dead.insert(store);
+          }
+        }
+        drop([&](const koopa_raw_value_t& other) {
+          return alias_analysis->alias(other, dest) ==
+                 AliasResult::MUST_ALIAS;
+        });
+        pending.push_back(inst);
+      } else if (inst->kind.tag == KOOPA_RVT_LOAD) {
+        auto& src = inst->kind.data.load.src;
+        drop([&](const koopa_raw_value_t& other) {
+          return alias_analysis->alias(other, src) != AliasResult::NO_ALIAS;
+        });
+      } else if (inst->kind.tag == KOOPA_RVT_CALL) {
+        drop([&](const koopa_raw_value_t& other) {
+          return alias_analysis->call_may_access(other);
+        });
+      }
+    }
+    return dead;
+  }
+
+ private:
+  AliasAnalysis* alias_analysis;
+  std::vector<std::pair<koopa_raw_value_t, koopa_raw_value_t>> entries;
+
+  template <typename Pred>
+  void erase_if(Pred pred) {
+    std::vector<std::pair<koopa_raw_value_t, koopa_raw_value_t>> kept;
+    for (auto& entry : entries) {
+      if (!pred(entry.first)) {
+        kept.push_back(entry);
+      }
+    }
+    entries.swap(kept);
+  }
+};
+
+};  // namespace KOOPA
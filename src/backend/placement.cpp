@@ -0,0 +1,130 @@
+#include "placement.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace KOOPA {
+
+void BlockPlacement::run(const koopa_raw_function_t& func) {
+  order.clear();
+  cold.clear();
+
+  // 1. the blocks to place, and where every block goes
+  std::vector<koopa_raw_basic_block_t> blocks;
+  std::unordered_map<koopa_raw_basic_block_t, int> position;
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    if (!switches->is_folded(bb)) {
+      position[bb] = blocks.size();
+      blocks.push_back(bb);
+    }
+  }
+  int n = blocks.size();
+  std::vector<std::vector<int>> succs(n);
+  for (int i = 0; i < n; ++i) {
+    auto& bb = blocks[i];
+    if (bb->insts.len == 0 || switches->chain_at(bb)) {
+      continue;
+    }
+    auto term = reinterpret_cast<koopa_raw_value_t>(
+        bb->insts.buffer[bb->insts.len - 1]);
+    std::vector<koopa_raw_basic_block_t> targets;
+    if (term->kind.tag == KOOPA_RVT_JUMP) {
+      targets = {term->kind.data.jump.target};
+    } else if (term->kind.tag == KOOPA_RVT_BRANCH) {
+      targets = {term->kind.data.branch.true_bb};
+      if (term->kind.data.branch.false_bb != targets[0]) {
+        targets.push_back(term->kind.data.branch.false_bb);
+      }
+    }
+    for (auto& target : targets) {
+      if (position.count(target)) {
+        succs[i].push_back(position[target]);
+      }
+    }
+  }
+
+  // 2. the weight of every edge
+  bool profiled = profile->available() && profile->entry_count() > 0;
+  std::vector<bool> never_ran(n, false);
+  std::vector<int> depth(n, 0);
+  for (int i = 0; i < n; ++i) {
+    never_ran[i] = profiled && profile->block_count(blocks[i]) == 0;
+    for (auto& to : succs[i]) {
+      for (int k = to; k <= i; ++k) {
+        depth[k] += 1;
+      }
+    }
+  }
+  struct Edge {
+    int from, to;
+    std::int64_t weight;
+  };
+  std::vector<Edge> edges;
+  const int max_depth = 6;
+  for (int i = 0; i < n; ++i) {
+    std::int64_t freq = std::int64_t(1) << (3 * std::min(depth[i], max_depth));
+    auto stays = [&](int to) { return to <= i || depth[to] >= depth[i]; };
+    for (auto& to : succs[i]) {
+      std::int64_t weight;
+      if (profiled) {
+        weight = profile->edge_count(blocks[i], blocks[to]);
+      } else if (succs[i].size() == 1) {
+        weight = 8 * freq;
+      } else {
+        auto other = succs[i][0] == to ? succs[i][1] : succs[i][0];
+        if (stays(to) == stays(other)) {
+          weight = 4 * freq;
+        } else {
+          weight = (stays(to) ? 7 : 1) * freq;
+        }
+      }
+      edges.push_back({i, to, weight});
+    }
+  }
+  std::stable_sort(edges.begin(), edges.end(),
+                   [](const Edge& a, const Edge& b) {
+                     if (a.weight != b.weight) {
+                       return a.weight > b.weight;
+                     }
+                     return a.to == a.from + 1 && b.to != b.from + 1;
+                   });
+
+  // 3. join the chains, the entry block stays at the front of its own.
+  // every chain keeps the index of its first block.
+  std::vector<int> chain_of(n);
+  std::vector<std::vector<int>> chains(n);
+  for (int i = 0; i < n; ++i) {
+    chain_of[i] = i;
+    chains[i] = {i};
+  }
+  for (auto& edge : edges) {
+    int a = chain_of[edge.from], b = chain_of[edge.to];
+    if (a == b || chains[a].back() != edge.from || b != edge.to ||
+        edge.to == 0 || never_ran[edge.from] != never_ran[edge.to]) {
+      continue;
+    }
+    for (auto& k : chains[b]) {
+      chain_of[k] = a;
+      chains[a].push_back(k);
+    }
+    chains[b].clear();
+  }
+
+  // 4. the chain of the entry block, the others, then the cold ones
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int i = 0; i < n; ++i) {
+      if (chains[i].empty() || never_ran[i] != (pass == 1)) {
+        continue;
+      }
+      for (auto& k : chains[i]) {
+        order.push_back(blocks[k]);
+        if (never_ran[k]) {
+          cold.insert(blocks[k]);
+        }
+      }
+    }
+  }
+}
+
+};  // namespace KOOPA
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <koopa.h>
+#include "visitor.hpp"
+#include "profile.hpp"
+#include "switch.hpp"
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+namespace KOOPA {
+
+/**
+ * the order the blocks of one function are emitted in
+ *
+ * bottom-up chaining (Pettis-Hansen): every block starts as a chain of its
+ * own, and the edges are visited from the heaviest down. an edge a -> b
+ * joins the chain ending in a with the one starting at b, so that a falls
+ * through to b. the chain of the entry block comes first, the others in
+ * the order of their first block. ties keep the layout of GenIRVisitor.
+ * 1. with a profile (see Profile), an edge weighs the times it was taken.
+ *    blocks that never ran in a function that did are cold: they go after
+ *    everything else, into .text.unlikely.
+ * 2. without one, a block inside n loops runs 8^n times. a loop is the
+ *    blocks between the target of an edge going back in the layout and its
+ *    source. a branch stays in its loop 7 times out of 8, and takes either
+ *    side half of the time otherwise.
+ * the tests folded into a switch dispatch are left out, and the head of
+ * such a chain always leaves with a j.
+ */
+class BlockPlacement : public Visitor {
+ public:
+  BlockPlacement(Profile* _profile, SwitchLowering* _switches)
+      : profile(_profile), switches(_switches) {}
+
+  void visit(const koopa_raw_function_t& func) override { run(func); }
+
+  void run(const koopa_raw_function_t& func);
+
+  const std::vector<koopa_raw_basic_block_t>& get_order() { return order; }
+
+  bool is_cold(const koopa_raw_basic_block_t& bb) {
+    return cold.count(bb) > 0;
+  }
+
+ private:
+  Profile* profile;
+  SwitchLowering* switches;
+  std::vector<koopa_raw_basic_block_t> order;
+  std::unordered_set<koopa_raw_basic_block_t> cold;
+};
+
+};  // namespace KOOPA
@@ -0,0 +1,311 @@
+#include "pre.hpp"
+
+#include <unordered_set>
+
+namespace KOOPA {
+
+// the operands an expression is computed from
+static std::vector<koopa_raw_value_t> get_operands(
+    const koopa_raw_value_t& inst) {
+  switch (inst->kind.tag) {
+    case KOOPA_RVT_BINARY:
+      return {inst->kind.data.binary.lhs, inst->kind.data.binary.rhs};
+    case KOOPA_RVT_GET_ELEM_PTR:
+      return {inst->kind.data.get_elem_ptr.src,
+              inst->kind.data.get_elem_ptr.index};
+    case KOOPA_RVT_GET_PTR:
+      return {inst->kind.data.get_ptr.src, inst->kind.data.get_ptr.index};
+    case KOOPA_RVT_LOAD:
+      return {inst->kind.data.load.src};
+    default:
+      return {};
+  }
+}
+
+// the instructions whose result lives in a stack slot of their own
+static bool has_slot(const koopa_raw_value_t& value) {
+  switch (value->kind.tag) {
+    case KOOPA_RVT_BINARY:
+    case KOOPA_RVT_LOAD:
+    case KOOPA_RVT_GET_ELEM_PTR:
+    case KOOPA_RVT_GET_PTR:
+      return true;
+    case KOOPA_RVT_CALL:
+      return value->ty->tag == KOOPA_RTT_INT32;
+    default:
+      return false;
+  }
+}
+
+static bool is_commutative(koopa_raw_binary_op_t op) {
+  return op == KOOPA_RBO_ADD || op == KOOPA_RBO_MUL || op == KOOPA_RBO_AND ||
+         op == KOOPA_RBO_OR || op == KOOPA_RBO_XOR || op == KOOPA_RBO_EQ ||
+         op == KOOPA_RBO_NOT_EQ;
+}
+
+void RedundancyElimination::run(const koopa_raw_function_t& func) {
+  equivalents.clear();
+  leaders.clear();
+  moves.clear();
+  hoisted.clear();
+  hoisted_count.clear();
+  referrers.clear();
+
+  // 1. the cfg, with the position of every block in the layout
+  std::unordered_map<koopa_raw_basic_block_t, int> position;
+  std::unordered_map<koopa_raw_basic_block_t,
+                     std::vector<koopa_raw_basic_block_t>>
+      preds;
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    position[bb] = i;
+  }
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    if (bb->insts.len == 0) {
+      continue;
+    }
+    auto term = reinterpret_cast<koopa_raw_value_t>(
+        bb->insts.buffer[bb->insts.len - 1]);
+    if (term->kind.tag == KOOPA_RVT_JUMP) {
+      preds[term->kind.data.jump.target].push_back(bb);
+    } else if (term->kind.tag == KOOPA_RVT_BRANCH) {
+      preds[term->kind.data.branch.true_bb].push_back(bb);
+      preds[term->kind.data.branch.false_bb].push_back(bb);
+    }
+  }
+
+  // 2. one pass in layout order
+  std::unordered_map<koopa_raw_basic_block_t, Available> avail_out;
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    auto& in_edges = preds[bb];
+    bool forward = i > 0 && !in_edges.empty();
+    for (auto& pred : in_edges) {
+      forward = forward && position[pred] < i;
+    }
+    // a branch with both targets here gives no edge to place values on
+    std::unordered_set<koopa_raw_basic_block_t> distinct(in_edges.begin(),
+                                                         in_edges.end());
+    bool join = forward && in_edges.size() >= 2 &&
+                distinct.size() == in_edges.size();
+
+    Available avail;
+    if (forward) {
+      avail = avail_out[in_edges[0]];
+      for (int k = 1; k < (int)in_edges.size(); ++k) {
+        auto& other = avail_out[in_edges[k]];
+        for (auto it = avail.begin(); it != avail.end();) {
+          auto found = other.find(it->first);
+          if (found == other.end() || found->second != it->second) {
+            it = avail.erase(it);
+          } else {
+            ++it;
+          }
+        }
+      }
+    }
+
+    std::unordered_set<koopa_raw_value_t> defined;
+    std::unordered_set<koopa_raw_value_t> stored;
+    for (int j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      defined.insert(inst);
+      if (inst->kind.tag == KOOPA_RVT_STORE) {
+        auto& store = inst->kind.data.store;
+        if (tracked(store.dest)) {
+          ExprKey key(KOOPA_RVT_LOAD, 0, operand(store.dest), Operand(0, 0));
+          avail.erase(key);
+          if (has_slot(store.value)) {
+            avail[key] = get_leader(store.value);
+          }
+          stored.insert(store.dest);
+        }
+        continue;
+      }
+      ExprKey key;
+      if (!make_key(inst, key)) {
+        continue;
+      }
+      auto it = avail.find(key);
+      if (it != avail.end()) {
+        equivalents[inst] = it->second;
+        referrers[it->second].push_back(bb);
+        leaders[inst] = it->second;
+        continue;
+      }
+      avail[key] = inst;
+      if (!join || (inst->kind.tag == KOOPA_RVT_LOAD &&
+                    stored.count(inst->kind.data.load.src))) {
+        continue;
+      }
+      // operands computed in this block must be on the edges as well
+      bool movable = true;
+      for (auto& op : get_operands(inst)) {
+        if (defined.count(op) && hoisted_from(op) != bb) {
+          movable = false;
+        }
+      }
+      if (!movable) {
+        continue;
+      }
+      // the value of the expression at the end of every predecessor
+      std::vector<koopa_raw_value_t> sources;
+      bool partial = false;
+      for (auto& pred : in_edges) {
+        bool ok = true;
+        auto pred_key = translate(key, bb, pred, ok);
+        koopa_raw_value_t source = nullptr;
+        if (ok) {
+          auto& out = avail_out[pred];
+          auto found = out.find(pred_key);
+          if (found != out.end()) {
+            source = found->second;
+            partial = true;
+          }
+        }
+        sources.push_back(source);
+      }
+      if (!partial) {
+        continue;
+      }
+      for (int k = 0; k < (int)in_edges.size(); ++k) {
+        moves[{in_edges[k], bb}].push_back({inst, sources[k]});
+        if (sources[k]) {
+          referrers[sources[k]].push_back(in_edges[k]);
+        }
+      }
+      hoisted[inst] = bb;
+      hoisted_count[inst] = in_edges.size();
+    }
+    avail_out[bb] = std::move(avail);
+  }
+}
+
+koopa_raw_value_t RedundancyElimination::equivalent(
+    const koopa_raw_value_t& value) {
+  auto it = equivalents.find(value);
+  return it == equivalents.end() ? nullptr : it->second;
+}
+
+const std::vector<EdgeMove>& RedundancyElimination::edge_moves(
+    const koopa_raw_basic_block_t& from, const koopa_raw_basic_block_t& to) {
+  auto it = moves.find({from, to});
+  return it == moves.end() ? no_moves : it->second;
+}
+
+const std::vector<koopa_raw_basic_block_t>&
+RedundancyElimination::referenced_in(const koopa_raw_value_t& value) {
+  auto it = referrers.find(value);
+  return it == referrers.end() ? no_blocks : it->second;
+}
+
+koopa_raw_basic_block_t RedundancyElimination::hoisted_from(
+    const koopa_raw_value_t& value) {
+  auto it = hoisted.find(value);
+  return it == hoisted.end() ? nullptr : it->second;
+}
+
+int RedundancyElimination::hoisted_edges(const koopa_raw_value_t& value) {
+  auto it = hoisted_count.find(value);
+  return it == hoisted_count.end() ? 0 : it->second;
+}
+
+koopa_raw_value_t RedundancyElimination::get_leader(
+    const koopa_raw_value_t& value) {
+  auto it = leaders.find(value);
+  return it == leaders.end() ? value : it->second;
+}
+
+RedundancyElimination::Operand RedundancyElimination::operand(
+    const koopa_raw_value_t& value) {
+  if (value->kind.tag == KOOPA_RVT_INTEGER) {
+    return {1, value->kind.data.integer.value};
+  }
+  return {0, reinterpret_cast<std::intptr_t>(get_leader(value))};
+}
+
+// a scalar alloc only the stores to itself can change
+bool RedundancyElimination::tracked(const koopa_raw_value_t& ptr) {
+  if (ptr->kind.tag != KOOPA_RVT_ALLOC) {
+    return false;
+  }
+  auto base = ptr->ty->data.pointer.base;
+  return (base->tag == KOOPA_RTT_INT32 || base->tag == KOOPA_RTT_POINTER) &&
+         !alias_analysis->call_may_access(ptr);
+}
+
+bool RedundancyElimination::make_key(const koopa_raw_value_t& inst,
+                                     ExprKey& key) {
+  auto tag = inst->kind.tag;
+  switch (tag) {
+    case KOOPA_RVT_BINARY: {
+      auto& binary = inst->kind.data.binary;
+      auto lhs = operand(binary.lhs);
+      auto rhs = operand(binary.rhs);
+      if (is_commutative(binary.op) && rhs < lhs) {
+        std::swap(lhs, rhs);
+      }
+      key = ExprKey(tag, binary.op, lhs, rhs);
+      return true;
+    }
+    case KOOPA_RVT_GET_ELEM_PTR:
+    case KOOPA_RVT_GET_PTR: {
+      auto ops = get_operands(inst);
+      key = ExprKey(tag, 0, operand(ops[0]), operand(ops[1]));
+      return true;
+    }
+    case KOOPA_RVT_LOAD: {
+      auto& src = inst->kind.data.load.src;
+      if (!tracked(src)) {
+        return false;
+      }
+      key = ExprKey(tag, 0, operand(src), Operand(0, 0));
+      return true;
+    }
+    default: {
+      return false;
+    }
+  }
+}
+
+/**
+ * key as seen at the end of pred: the values moved out of join stand for
+ * their source on that edge. ok is cleared if one of them is computed on
+ * the edge, nothing in pred holds it then.
+ */
+RedundancyElimination::ExprKey RedundancyElimination::translate(
+    const ExprKey& key, const koopa_raw_basic_block_t& join,
+    const koopa_raw_basic_block_t& pred, bool& ok) {
+  auto map = [&](const Operand& op) {
+    if (op.first == 1 || op.second == 0) {
+      return op;
+    }
+    auto value = reinterpret_cast<koopa_raw_value_t>(op.second);
+    if (hoisted_from(value) != join) {
+      return op;
+    }
+    for (auto& move : edge_moves(pred, join)) {
+      if (move.value == value) {
+        if (move.source == nullptr) {
+          ok = false;
+          return op;
+        }
+        return Operand(0, reinterpret_cast<std::intptr_t>(
+                              get_leader(move.source)));
+      }
+    }
+    ok = false;
+    return op;
+  };
+  auto result = ExprKey(std::get<0>(key), std::get<1>(key),
+                        map(std::get<2>(key)), map(std::get<3>(key)));
+  if (std::get<0>(result) == KOOPA_RVT_BINARY &&
+      is_commutative((koopa_raw_binary_op_t)std::get<1>(result)) &&
+      std::get<3>(result) < std::get<2>(result)) {
+    std::swap(std::get<2>(result), std::get<3>(result));
+  }
+  return result;
+}
+
+};  // namespace KOOPA
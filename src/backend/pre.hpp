@@ -0,0 +1,104 @@
+#pragma once
+
+#include <koopa.h>
+#include "visitor.hpp"
+#include "alias.hpp"
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace KOOPA {
+
+/**
+ * a value to materialize on a cfg edge, right before control enters the
+ * block of value: copy it from the slot of source, or compute value itself
+ * when source is nullptr
+ */
+struct EdgeMove {
+  koopa_raw_value_t value;
+  koopa_raw_value_t source;
+};
+
+/**
+ * global redundancy elimination over the raw program of one function
+ *
+ * the expressions are binary ops, getelemptr / getptr (address
+ * computations) and loads of scalar allocs whose address never escapes, so
+ * that only a store to the alloc itself can change them. a store makes the
+ * stored value available as a load of its alloc.
+ *
+ * run() walks the blocks once in layout order and keeps the expressions
+ * available at every point, the intersection over the predecessors at the
+ * start of a block. a block with a predecessor laid out after it (a loop
+ * header) starts empty.
+ * 1. an expression already available is fully redundant: equivalent() gives
+ *    the earlier value, and later expressions use that value as operand
+ * 2. partial redundancy (lazy code motion): at a join whose predecessors
+ *    all come before it, an expression available from some predecessors
+ *    but not from others is made available on every incoming edge. edges
+ *    where it is available copy it, the others compute it, and the join
+ *    itself no longer does. an operand that is such a value of the join
+ *    stands for its source on each edge (phi translation), so a chain like
+ *    load a; load b; mul moves as a whole.
+ * the code generator keeps the computation in the join when it can't place
+ * the value on one of the edges (e.g. an operand without a slot yet).
+ */
+class RedundancyElimination : public Visitor {
+ public:
+  explicit RedundancyElimination(AliasAnalysis* _alias_analysis)
+      : alias_analysis(_alias_analysis) {}
+
+  void visit(const koopa_raw_function_t& func) override { run(func); }
+
+  void run(const koopa_raw_function_t& func);
+
+  // an earlier value equal to value on every path, nullptr if none
+  koopa_raw_value_t equivalent(const koopa_raw_value_t& value);
+
+  const std::vector<EdgeMove>& edge_moves(const koopa_raw_basic_block_t& from,
+                                          const koopa_raw_basic_block_t& to);
+
+  /**
+   * the blocks reading the slot of value in place of their own
+   * computation: those of its equivalents, and the predecessors copying it
+   * onto an edge (at their end)
+   */
+  const std::vector<koopa_raw_basic_block_t>& referenced_in(
+      const koopa_raw_value_t& value);
+
+  // the join value was moved out of, nullptr if it stays where it is
+  koopa_raw_basic_block_t hoisted_from(const koopa_raw_value_t& value);
+
+  // number of edges value has to be placed on to leave its block
+  int hoisted_edges(const koopa_raw_value_t& value);
+
+ private:
+  // (is integer, integer value or value address)
+  using Operand = std::pair<int, std::intptr_t>;
+  using ExprKey = std::tuple<int, int, Operand, Operand>;
+  using Available = std::map<ExprKey, koopa_raw_value_t>;
+  using Edge = std::pair<koopa_raw_basic_block_t, koopa_raw_basic_block_t>;
+
+  AliasAnalysis* alias_analysis;
+  std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> equivalents;
+  std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> leaders;
+  std::map<Edge, std::vector<EdgeMove>> moves;
+  std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> hoisted;
+  std::unordered_map<koopa_raw_value_t, int> hoisted_count;
+  std::unordered_map<koopa_raw_value_t, std::vector<koopa_raw_basic_block_t>>
+      referrers;
+  std::vector<EdgeMove> no_moves;
+  std::vector<koopa_raw_basic_block_t> no_blocks;
+
+  koopa_raw_value_t get_leader(const koopa_raw_value_t& value);
+  Operand operand(const koopa_raw_value_t& value);
+  bool tracked(const koopa_raw_value_t& ptr);
+  bool make_key(const koopa_raw_value_t& inst, ExprKey& key);
+  ExprKey translate(const ExprKey& key, const koopa_raw_basic_block_t& join,
+                    const koopa_raw_basic_block_t& pred, bool& ok);
+};
+
+};  // namespace KOOPA
@@ -8,6 +8,7 @@
 #include "regpool.hpp"
 #include <vector>
 #include "stack.hpp"
+#include "utils.hpp"
 
 namespace KOOPA {
 
@@ -122,10 +123,16 @@ class PrepareOperandVisitor : public Visitor {
         break;
       }
       case KOOPA_RVT_GLOBAL_ALLOC: {
-        asm_code.append("  la " + load_reg_name + ", " +
-                        std::string(value->name).substr(1) + "\n");
-        asm_code.append("  lw " + load_reg_name + ", 0(" + load_reg_name +
-                        ")\n");
+        auto sym = std::string(value->name).substr(1);
+        if (is_small_global(value)) {
+          asm_code.append("  lui " + load_reg_name + ", %hi(" + sym + ")\n");
+          asm_code.append("  lw " + load_reg_name + ", %lo(" + sym + ")(" +
+                          load_reg_name + ")\n");
+        } else {
+          asm_code.append("  la " + load_reg_name + ", " + sym + "\n");
+          asm_code.append("  lw " + load_reg_name + ", 0(" + load_reg_name +
+                          ")\n");
+        }
         break;
       }
       default: {
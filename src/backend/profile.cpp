@@ -0,0 +1,143 @@
+#include "profile.hpp"
+
+#include <fstream>
+#include <sstream>
+
+namespace KOOPA {
+
+static std::string block_name(const koopa_raw_basic_block_t& bb) {
+  return bb->name ? std::string(bb->name).substr(1) : "?";
+}
+
+std::string profile_key(const koopa_raw_function_t& func,
+                        const koopa_raw_basic_block_t& from,
+                        const koopa_raw_basic_block_t& to) {
+  return std::string(func->name).substr(1) + " " +
+         (from ? block_name(from) : "-") + " " + block_name(to);
+}
+
+static std::string quote(const std::string& text) {
+  std::string quoted = "\"";
+  for (auto c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+std::string gen_profile_runtime(const std::vector<std::string>& keys,
+                                const std::string& path) {
+  if (keys.empty()) {
+    return "";
+  }
+  int n = keys.size();
+  std::string code;
+  code += "  .bss\n  .align 2\n__profile_counts:\n";
+  code += "  .zero " + std::to_string(4 * n) + "\n";
+
+  code += "  .section .rodata\n  .align 2\n__profile_keys:\n";
+  for (int i = 0; i < n; ++i) {
+    code += "  .word __profile_key_" + std::to_string(i) + "\n";
+  }
+  for (int i = 0; i < n; ++i) {
+    code += "__profile_key_" + std::to_string(i) + ":\n";
+    code += "  .string " + quote(keys[i]) + "\n";
+  }
+  code += "__profile_path:\n  .string " + quote(path) + "\n";
+  code += "__profile_mode:\n  .string \"w\"\n";
+  code += "__profile_format:\n  .string \"%s %u\\n\"\n";
+
+  // s0 holds the file, s1 the index of the counter
+  code += "  .text\n__profile_dump:\n";
+  code += "  addi sp, sp, -16\n";
+  code += "  sw ra, 12(sp)\n  sw s0, 8(sp)\n  sw s1, 4(sp)\n";
+  code += "  la a0, __profile_path\n  la a1, __profile_mode\n";
+  code += "  call fopen\n";
+  code += "  beqz a0, __profile_dump_end\n";
+  code += "  mv s0, a0\n  li s1, 0\n";
+  code += "__profile_dump_loop:\n";
+  code += "  slli t0, s1, 2\n";
+  code += "  la t1, __profile_keys\n  add t1, t1, t0\n  lw a2, 0(t1)\n";
+  code += "  la t1, __profile_counts\n  add t1, t1, t0\n  lw a3, 0(t1)\n";
+  code += "  mv a0, s0\n  la a1, __profile_format\n";
+  code += "  call fprintf\n";
+  code += "  addi s1, s1, 1\n";
+  code += "  li t0, " + std::to_string(n) + "\n";
+  code += "  blt s1, t0, __profile_dump_loop\n";
+  code += "  mv a0, s0\n  call fclose\n";
+  code += "__profile_dump_end:\n";
+  code += "  lw ra, 12(sp)\n  lw s0, 8(sp)\n  lw s1, 4(sp)\n";
+  code += "  addi sp, sp, 16\n  ret\n";
+
+  code += "  .section .fini_array,\"aw\"\n  .align 2\n";
+  code += "  .word __profile_dump\n";
+  return code;
+}
+
+bool Profile::load(const std::string& path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string func, from, to;
+    std::int64_t count;
+    if (fields >> func >> from >> to >> count) {
+      counts[func + " " + from + " " + to] += count;
+    }
+  }
+  return true;
+}
+
+void Profile::run(const koopa_raw_function_t& func) {
+  edges.clear();
+  blocks.clear();
+  auto entry = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0]);
+  auto it = counts.find(profile_key(func, nullptr, entry));
+  has_counts = it != counts.end();
+  entries = has_counts ? it->second : 0;
+  if (!has_counts) {
+    return;
+  }
+  blocks[entry] += entries;
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    if (bb->insts.len == 0) {
+      continue;
+    }
+    auto term = reinterpret_cast<koopa_raw_value_t>(
+        bb->insts.buffer[bb->insts.len - 1]);
+    std::vector<koopa_raw_basic_block_t> succs;
+    if (term->kind.tag == KOOPA_RVT_JUMP) {
+      succs.push_back(term->kind.data.jump.target);
+    } else if (term->kind.tag == KOOPA_RVT_BRANCH) {
+      succs.push_back(term->kind.data.branch.true_bb);
+      if (term->kind.data.branch.false_bb != succs[0]) {
+        succs.push_back(term->kind.data.branch.false_bb);
+      }
+    }
+    for (auto& succ : succs) {
+      auto edge = counts.find(profile_key(func, bb, succ));
+      auto count = edge == counts.end() ? 0 : edge->second;
+      edges[{bb, succ}] = count;
+      blocks[succ] += count;
+    }
+  }
+}
+
+std::int64_t Profile::edge_count(const koopa_raw_basic_block_t& from,
+                                 const koopa_raw_basic_block_t& to) {
+  auto it = edges.find({from, to});
+  return it == edges.end() ? 0 : it->second;
+}
+
+std::int64_t Profile::block_count(const koopa_raw_basic_block_t& bb) {
+  auto it = blocks.find(bb);
+  return it == blocks.end() ? 0 : it->second;
+}
+
+};  // namespace KOOPA
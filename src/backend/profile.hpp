@@ -0,0 +1,72 @@
+#pragma once
+
+#include <koopa.h>
+#include "visitor.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace KOOPA {
+
+/**
+ * the name of the counter for the edge from -> to of func, e.g.
+ * "main while_entry_0 while_body_1". from is nullptr for the counter of
+ * the calls of func ("main - entry_main").
+ */
+std::string profile_key(const koopa_raw_function_t& func,
+                        const koopa_raw_basic_block_t& from,
+                        const koopa_raw_basic_block_t& to);
+
+/**
+ * the runtime of -fprofile-generate: the counters (.bss) and a function
+ * run from .fini_array after main returns, which writes one line
+ * "<key> <count>" per counter to path with fopen / fprintf / fclose
+ */
+std::string gen_profile_runtime(const std::vector<std::string>& keys,
+                                const std::string& path);
+
+/**
+ * edge profile of a program, as written by code built with
+ * -fprofile-generate and read back with -fprofile-use
+ *
+ * the counters sit on the edges of the raw program (see profile_key), so
+ * a profile only fits the program compiled from the same source with the
+ * same flags. run() picks the counts of one function, the queries below
+ * answer for it. a function the profile doesn't mention has no counts,
+ * and the passes fall back to their static choices.
+ */
+class Profile : public Visitor {
+ public:
+  // false if path can't be read
+  bool load(const std::string& path);
+
+  void visit(const koopa_raw_function_t& func) override { run(func); }
+
+  void run(const koopa_raw_function_t& func);
+
+  // whether the current function was compiled with counters
+  bool available() const { return has_counts; }
+
+  std::int64_t entry_count() const { return entries; }
+
+  std::int64_t edge_count(const koopa_raw_basic_block_t& from,
+                          const koopa_raw_basic_block_t& to);
+
+  // the number of times control entered bb
+  std::int64_t block_count(const koopa_raw_basic_block_t& bb);
+
+ private:
+  using Edge = std::pair<koopa_raw_basic_block_t, koopa_raw_basic_block_t>;
+
+  // every line of the file, by key
+  std::unordered_map<std::string, std::int64_t> counts;
+  bool has_counts = false;
+  std::int64_t entries = 0;
+  std::map<Edge, std::int64_t> edges;
+  std::unordered_map<koopa_raw_basic_block_t, std::int64_t> blocks;
+};
+
+};  // namespace KOOPA
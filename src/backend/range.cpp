@@ -0,0 +1,531 @@
+#include "range.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace KOOPA {
+
+static Range make_range(std::int64_t lo, std::int64_t hi) {
+  Range range;
+  range.lo = lo;
+  range.hi = hi;
+  return range;
+}
+
+// the full range if the result of an op may wrap around
+static Range fit(std::int64_t lo, std::int64_t hi) {
+  if (lo < INT_MIN || hi > INT_MAX) {
+    return Range();
+  }
+  return make_range(lo, hi);
+}
+
+static Range hull(const Range& a, const Range& b) {
+  return make_range(std::min(a.lo, b.lo), std::max(a.hi, b.hi));
+}
+
+static bool same_range(const Range& a, const Range& b) {
+  return a.lo == b.lo && a.hi == b.hi;
+}
+
+// an alloc missing on one side may hold anything, so it is dropped
+template <typename State>
+static State join(const State& a, const State& b) {
+  State result;
+  for (auto& [alloc, range] : a) {
+    auto it = b.find(alloc);
+    if (it != b.end()) {
+      result[alloc] = hull(range, it->second);
+    }
+  }
+  return result;
+}
+
+template <typename State>
+static bool same_state(const State& a, const State& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (auto& [alloc, range] : a) {
+    auto it = b.find(alloc);
+    if (it == b.end() || !same_range(range, it->second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool is_compare(koopa_raw_binary_op_t op) {
+  return op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ || op == KOOPA_RBO_LT ||
+         op == KOOPA_RBO_GT || op == KOOPA_RBO_LE || op == KOOPA_RBO_GE;
+}
+
+// the comparison that holds when op does not
+static koopa_raw_binary_op_t negate(koopa_raw_binary_op_t op) {
+  switch (op) {
+    case KOOPA_RBO_EQ:
+      return KOOPA_RBO_NOT_EQ;
+    case KOOPA_RBO_NOT_EQ:
+      return KOOPA_RBO_EQ;
+    case KOOPA_RBO_LT:
+      return KOOPA_RBO_GE;
+    case KOOPA_RBO_GE:
+      return KOOPA_RBO_LT;
+    case KOOPA_RBO_GT:
+      return KOOPA_RBO_LE;
+    default:
+      return KOOPA_RBO_GT;
+  }
+}
+
+void RangeAnalysis::run(const koopa_raw_function_t& func) {
+  ranges.clear();
+  states.clear();
+  edge_states.clear();
+  thresholds = {INT_MIN, INT_MIN + 1, INT_MAX - 1, INT_MAX};
+  if (func->bbs.len == 0) {
+    return;
+  }
+
+  // 1. the cfg, and the constants the program compares against
+  std::unordered_map<koopa_raw_basic_block_t, int> position;
+  std::unordered_map<koopa_raw_basic_block_t,
+                     std::vector<koopa_raw_basic_block_t>>
+      preds;
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    position[bb] = i;
+    for (int j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      auto& kind = inst->kind;
+      if (kind.tag == KOOPA_RVT_JUMP) {
+        preds[kind.data.jump.target].push_back(bb);
+      } else if (kind.tag == KOOPA_RVT_BRANCH) {
+        preds[kind.data.branch.true_bb].push_back(bb);
+        preds[kind.data.branch.false_bb].push_back(bb);
+      } else if (kind.tag == KOOPA_RVT_BINARY &&
+                 is_compare(kind.data.binary.op)) {
+        for (auto& op : {kind.data.binary.lhs, kind.data.binary.rhs}) {
+          if (op->kind.tag == KOOPA_RVT_INTEGER) {
+            std::int64_t c = op->kind.data.integer.value;
+            for (auto bound : {c - 1, c, c + 1}) {
+              if (bound >= INT_MIN && bound <= INT_MAX) {
+                thresholds.push_back(bound);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  std::sort(thresholds.begin(), thresholds.end());
+  thresholds.erase(std::unique(thresholds.begin(), thresholds.end()),
+                   thresholds.end());
+
+  // 2. iterate to a fixed point, giving up (nothing known) if it is slow.
+  // the states so far only cover part of the runs, known_target must not
+  // see them either.
+  const int max_passes = 100;
+  bool changed = true;
+  for (int pass = 0; changed; ++pass) {
+    if (pass == max_passes) {
+      ranges.clear();
+      states.clear();
+      edge_states.clear();
+      return;
+    }
+    changed = false;
+    for (int i = 0; i < func->bbs.len; ++i) {
+      auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+      State in;
+      bool reached = i == 0;
+      bool loop_head = false;
+      for (auto& pred : preds[bb]) {
+        loop_head = loop_head || position[pred] >= i;
+        auto it = edge_states.find({pred, bb});
+        if (it == edge_states.end() || i == 0) {
+          continue;
+        }
+        in = reached ? join(in, it->second) : it->second;
+        reached = true;
+      }
+      if (!reached) {
+        continue;
+      }
+      auto old = states.find(bb);
+      if (old == states.end()) {
+        changed = true;
+      } else {
+        // the state only grows, and a loop head jumps to the next threshold
+        State merged;
+        for (auto& [alloc, range] : old->second) {
+          auto it = in.find(alloc);
+          if (it != in.end()) {
+            auto grown = hull(range, it->second);
+            merged[alloc] = loop_head ? widen(range, grown) : grown;
+          }
+        }
+        changed = changed || !same_state(merged, old->second);
+        in = std::move(merged);
+      }
+      states[bb] = in;
+      changed = transfer(bb, std::move(in)) || changed;
+    }
+  }
+}
+
+Range RangeAnalysis::get_range(const koopa_raw_value_t& value) {
+  if (value->kind.tag == KOOPA_RVT_INTEGER) {
+    return make_range(value->kind.data.integer.value,
+                      value->kind.data.integer.value);
+  }
+  auto it = ranges.find(value);
+  return it == ranges.end() ? Range() : it->second;
+}
+
+// the range on a path where local holds, in place of the one of ranges
+Range RangeAnalysis::get_range(const koopa_raw_value_t& value,
+                               const Ranges& local) {
+  auto it = local.find(value);
+  return it == local.end() ? get_range(value) : it->second;
+}
+
+koopa_raw_basic_block_t RangeAnalysis::known_target(
+    const koopa_raw_basic_block_t& pred, const koopa_raw_basic_block_t& bb) {
+  auto it = edge_states.find({pred, bb});
+  if (it == edge_states.end() || bb->insts.len == 0) {
+    return nullptr;
+  }
+  // run bb once more, on the state of this edge only
+  auto state = it->second;
+  Ranges local;
+  for (int j = 0; j < bb->insts.len - 1; ++j) {
+    auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+    auto& kind = inst->kind;
+    if (kind.tag == KOOPA_RVT_STORE && tracked(kind.data.store.dest)) {
+      state[kind.data.store.dest] = get_range(kind.data.store.value, local);
+    } else if (kind.tag == KOOPA_RVT_LOAD && tracked(kind.data.load.src)) {
+      auto found = state.find(kind.data.load.src);
+      local[inst] = found == state.end() ? Range() : found->second;
+    } else if (kind.tag == KOOPA_RVT_BINARY) {
+      local[inst] = eval(kind.data.binary, local);
+    }
+  }
+  auto term =
+      reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]);
+  if (term->kind.tag != KOOPA_RVT_BRANCH) {
+    return nullptr;
+  }
+  auto& branch = term->kind.data.branch;
+  auto c = get_range(branch.cond, local);
+  if (c.lo > 0 || c.hi < 0) {
+    return branch.true_bb;
+  }
+  return c.is_constant() ? branch.false_bb : nullptr;
+}
+
+// a scalar alloc only the stores to itself can change
+bool RangeAnalysis::tracked(const koopa_raw_value_t& ptr) {
+  return ptr->kind.tag == KOOPA_RVT_ALLOC &&
+         ptr->ty->data.pointer.base->tag == KOOPA_RTT_INT32 &&
+         !alias_analysis->call_may_access(ptr);
+}
+
+// run the block on state, true if a value or an outgoing edge changed
+bool RangeAnalysis::transfer(const koopa_raw_basic_block_t& bb, State state) {
+  bool changed = false;
+  // the value each alloc holds since a load or store of this block
+  std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> current;
+  auto leave = [&](const koopa_raw_basic_block_t& target, const State& out) {
+    auto it = edge_states.find({bb, target});
+    if (it == edge_states.end()) {
+      edge_states[{bb, target}] = out;
+      changed = true;
+    } else {
+      auto merged = join(it->second, out);
+      if (!same_state(merged, it->second)) {
+        it->second = std::move(merged);
+        changed = true;
+      }
+    }
+  };
+  for (int j = 0; j < bb->insts.len; ++j) {
+    auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+    auto& kind = inst->kind;
+    switch (kind.tag) {
+      case KOOPA_RVT_STORE: {
+        auto& dest = kind.data.store.dest;
+        if (tracked(dest)) {
+          state[dest] = get_range(kind.data.store.value);
+          current[dest] = kind.data.store.value;
+        }
+        break;
+      }
+      case KOOPA_RVT_LOAD: {
+        auto& src = kind.data.load.src;
+        Range range;
+        if (tracked(src)) {
+          auto it = state.find(src);
+          if (it != state.end()) {
+            range = it->second;
+          }
+          current[src] = inst;
+        }
+        changed = update(inst, range) || changed;
+        break;
+      }
+      case KOOPA_RVT_BINARY: {
+        changed = update(inst, eval(kind.data.binary, no_ranges)) || changed;
+        break;
+      }
+      case KOOPA_RVT_JUMP: {
+        leave(kind.data.jump.target, state);
+        break;
+      }
+      case KOOPA_RVT_BRANCH: {
+        auto& branch = kind.data.branch;
+        State taken = state;
+        if (narrow(taken, branch.cond, true, current)) {
+          leave(branch.true_bb, taken);
+        }
+        if (narrow(state, branch.cond, false, current)) {
+          leave(branch.false_bb, state);
+        }
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+  return changed;
+}
+
+bool RangeAnalysis::update(const koopa_raw_value_t& value,
+                           const Range& range) {
+  auto it = ranges.find(value);
+  if (it == ranges.end()) {
+    ranges[value] = range;
+    return true;
+  }
+  auto grown = hull(it->second, range);
+  if (same_range(grown, it->second)) {
+    return false;
+  }
+  it->second = grown;
+  return true;
+}
+
+Range RangeAnalysis::eval(const koopa_raw_binary_t& binary,
+                          const Ranges& local) {
+  auto l = get_range(binary.lhs, local);
+  auto r = get_range(binary.rhs, local);
+  auto boolean = [](bool always, bool never) {
+    return always ? make_range(1, 1)
+                  : (never ? make_range(0, 0) : make_range(0, 1));
+  };
+  switch (binary.op) {
+    case KOOPA_RBO_ADD: {
+      return fit(l.lo + r.lo, l.hi + r.hi);
+    }
+    case KOOPA_RBO_SUB: {
+      return fit(l.lo - r.hi, l.hi - r.lo);
+    }
+    case KOOPA_RBO_MUL: {
+      std::int64_t corners[] = {l.lo * r.lo, l.lo * r.hi, l.hi * r.lo,
+                                l.hi * r.hi};
+      return fit(*std::min_element(corners, corners + 4),
+                 *std::max_element(corners, corners + 4));
+    }
+    case KOOPA_RBO_DIV: {
+      // monotonic in both operands as long as the divisor keeps its sign
+      bool overflow = l.lo == INT_MIN && r.lo <= -1 && r.hi >= -1;
+      if ((r.lo > 0 || r.hi < 0) && !overflow) {
+        std::int64_t corners[] = {l.lo / r.lo, l.lo / r.hi, l.hi / r.lo,
+                                  l.hi / r.hi};
+        return make_range(*std::min_element(corners, corners + 4),
+                          *std::max_element(corners, corners + 4));
+      }
+      return Range();
+    }
+    case KOOPA_RBO_MOD: {
+      // the result takes the sign of lhs and is smaller than |rhs|
+      if (r.lo > 0 || r.hi < 0) {
+        auto min_abs = std::min(std::abs(r.lo), std::abs(r.hi));
+        auto max_abs = std::max(std::abs(r.lo), std::abs(r.hi));
+        if (l.lo >= 0) {
+          return l.hi < min_abs ? l
+                                : make_range(0, std::min(l.hi, max_abs - 1));
+        }
+        if (l.hi <= 0) {
+          return l.lo > -min_abs ? l
+                                 : make_range(std::max(l.lo, 1 - max_abs), 0);
+        }
+        return make_range(1 - max_abs, max_abs - 1);
+      }
+      return l.lo >= 0 ? make_range(0, l.hi) : Range();
+    }
+    case KOOPA_RBO_LT: {
+      return boolean(l.hi < r.lo, l.lo >= r.hi);
+    }
+    case KOOPA_RBO_GT: {
+      return boolean(l.lo > r.hi, l.hi <= r.lo);
+    }
+    case KOOPA_RBO_LE: {
+      return boolean(l.hi <= r.lo, l.lo > r.hi);
+    }
+    case KOOPA_RBO_GE: {
+      return boolean(l.lo >= r.hi, l.hi < r.lo);
+    }
+    case KOOPA_RBO_EQ: {
+      return boolean(l.is_constant() && same_range(l, r),
+                     l.hi < r.lo || r.hi < l.lo);
+    }
+    case KOOPA_RBO_NOT_EQ: {
+      return boolean(l.hi < r.lo || r.hi < l.lo,
+                     l.is_constant() && same_range(l, r));
+    }
+    case KOOPA_RBO_AND: {
+      if (l.non_negative() || r.non_negative()) {
+        auto hi = INT_MAX;
+        if (l.non_negative()) {
+          hi = std::min<std::int64_t>(hi, l.hi);
+        }
+        if (r.non_negative()) {
+          hi = std::min<std::int64_t>(hi, r.hi);
+        }
+        return make_range(0, hi);
+      }
+      return Range();
+    }
+    case KOOPA_RBO_OR:
+    case KOOPA_RBO_XOR: {
+      if (l.non_negative() && r.non_negative()) {
+        std::int64_t mask = 0;
+        while (mask < std::max(l.hi, r.hi)) {
+          mask = mask * 2 + 1;
+        }
+        return make_range(0, mask);
+      }
+      return Range();
+    }
+    default: {
+      return Range();
+    }
+  }
+}
+
+/**
+ * narrow state to the edge where cond is taken (or not), false if that
+ * edge is never taken. only allocs still holding an operand of the
+ * comparison learn something.
+ */
+bool RangeAnalysis::narrow(
+    State& state, const koopa_raw_value_t& cond, bool taken,
+    const std::unordered_map<koopa_raw_value_t, koopa_raw_value_t>& current) {
+  auto limit = [&](const koopa_raw_value_t& value, Range range) {
+    if (range.lo > range.hi) {
+      return false;
+    }
+    for (auto& [alloc, held] : current) {
+      if (held != value) {
+        continue;
+      }
+      auto it = state.find(alloc);
+      if (it != state.end()) {
+        range.lo = std::max(range.lo, it->second.lo);
+        range.hi = std::min(range.hi, it->second.hi);
+      }
+      if (range.lo > range.hi) {
+        return false;
+      }
+      state[alloc] = range;
+    }
+    return true;
+  };
+
+  // 1. the condition itself is non-zero, or zero
+  auto c = get_range(cond);
+  if (taken) {
+    if (c.lo == 0) {
+      c.lo = 1;
+    }
+    if (c.hi == 0) {
+      c.hi = -1;
+    }
+  } else {
+    c.lo = std::max<std::int64_t>(c.lo, 0);
+    c.hi = std::min<std::int64_t>(c.hi, 0);
+  }
+  if (!limit(cond, c)) {
+    return false;
+  }
+  if (cond->kind.tag != KOOPA_RVT_BINARY ||
+      !is_compare(cond->kind.data.binary.op)) {
+    return true;
+  }
+
+  // 2. the operands of a comparison
+  auto& binary = cond->kind.data.binary;
+  auto op = taken ? binary.op : negate(binary.op);
+  auto l = get_range(binary.lhs);
+  auto r = get_range(binary.rhs);
+  auto new_l = l;
+  auto new_r = r;
+  switch (op) {
+    case KOOPA_RBO_LT: {
+      new_l.hi = std::min(l.hi, r.hi - 1);
+      new_r.lo = std::max(r.lo, l.lo + 1);
+      break;
+    }
+    case KOOPA_RBO_LE: {
+      new_l.hi = std::min(l.hi, r.hi);
+      new_r.lo = std::max(r.lo, l.lo);
+      break;
+    }
+    case KOOPA_RBO_GT: {
+      new_l.lo = std::max(l.lo, r.lo + 1);
+      new_r.hi = std::min(r.hi, l.hi - 1);
+      break;
+    }
+    case KOOPA_RBO_GE: {
+      new_l.lo = std::max(l.lo, r.lo);
+      new_r.hi = std::min(r.hi, l.hi);
+      break;
+    }
+    case KOOPA_RBO_EQ: {
+      new_l.lo = new_r.lo = std::max(l.lo, r.lo);
+      new_l.hi = new_r.hi = std::min(l.hi, r.hi);
+      break;
+    }
+    default: {
+      // only a constant at one end of the other range cuts it
+      if (r.is_constant()) {
+        new_l.lo += l.lo == r.lo;
+        new_l.hi -= l.hi == r.lo;
+      }
+      if (l.is_constant()) {
+        new_r.lo += r.lo == l.lo;
+        new_r.hi -= r.hi == l.lo;
+      }
+      break;
+    }
+  }
+  return limit(binary.lhs, new_l) && limit(binary.rhs, new_r);
+}
+
+Range RangeAnalysis::widen(const Range& old_range, const Range& new_range) {
+  auto range = new_range;
+  if (new_range.lo < old_range.lo) {
+    range.lo = *(std::upper_bound(thresholds.begin(), thresholds.end(),
+                                  new_range.lo) -
+                 1);
+  }
+  if (new_range.hi > old_range.hi) {
+    range.hi = *std::lower_bound(thresholds.begin(), thresholds.end(),
+                                 new_range.hi);
+  }
+  return range;
+}
+
+};  // namespace KOOPA
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <koopa.h>
+#include "visitor.hpp"
+#include "alias.hpp"
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace KOOPA {
+
+// the values an i32 may take, lo <= hi (kept in 64 bits to see overflow)
+struct Range {
+  std::int64_t lo = INT_MIN;
+  std::int64_t hi = INT_MAX;
+
+  bool is_constant() const { return lo == hi; }
+  bool non_negative() const { return lo >= 0; }
+};
+
+/**
+ * value range analysis over the raw program of one function
+ *
+ * the state at every point is a range for each scalar alloc whose address
+ * never escapes (see AliasAnalysis), so that only its own stores change
+ * it. run() iterates over the blocks in layout order until no state
+ * changes:
+ * 1. a store sets the range of its alloc, a load reads it, and binary ops
+ *    combine the ranges of their operands (anything that may overflow
+ *    gives the full range)
+ * 2. a branch on a comparison of a loaded value narrows the alloc on each
+ *    edge, e.g. i < n gives i <= n.hi - 1 on the true edge. an edge whose
+ *    condition is known to be false is never taken.
+ * 3. a block entered from a later one (a loop header) widens the bounds
+ *    that keep growing to the next comparison constant, or to the limits
+ *    of i32, so that a counter from 0 to n ends up as [0, INT_MAX - 1]
+ *    rather than wrapping around
+ * every value gets the union of its ranges over all iterations.
+ */
+class RangeAnalysis : public Visitor {
+ public:
+  explicit RangeAnalysis(AliasAnalysis* _alias_analysis)
+      : alias_analysis(_alias_analysis) {}
+
+  void visit(const koopa_raw_function_t& func) override { run(func); }
+
+  void run(const koopa_raw_function_t& func);
+
+  // the full range for values we know nothing about
+  Range get_range(const koopa_raw_value_t& value);
+
+  /**
+   * the block the branch ending bb goes to when bb is entered from pred,
+   * nullptr if the ranges on that edge don't decide it. e.g. after
+   * flag = 1; break; a block testing flag always takes the true side.
+   */
+  koopa_raw_basic_block_t known_target(const koopa_raw_basic_block_t& pred,
+                                       const koopa_raw_basic_block_t& bb);
+
+ private:
+  using Ranges = std::unordered_map<koopa_raw_value_t, Range>;
+  // range of every tracked alloc, a missing alloc may hold anything
+  using State = Ranges;
+  using Edge = std::pair<koopa_raw_basic_block_t, koopa_raw_basic_block_t>;
+
+  AliasAnalysis* alias_analysis;
+  Ranges ranges;
+  Ranges no_ranges;
+  // states at the start of the reached blocks, and on the feasible edges
+  std::unordered_map<koopa_raw_basic_block_t, State> states;
+  std::map<Edge, State> edge_states;
+  // the bounds widening may stop at, sorted
+  std::vector<std::int64_t> thresholds;
+
+  bool tracked(const koopa_raw_value_t& ptr);
+  bool transfer(const koopa_raw_basic_block_t& bb, State state);
+  bool update(const koopa_raw_value_t& value, const Range& range);
+  Range get_range(const koopa_raw_value_t& value, const Ranges& local);
+  Range eval(const koopa_raw_binary_t& binary, const Ranges& local);
+  bool narrow(State& state, const koopa_raw_value_t& cond, bool taken,
+              const std::unordered_map<koopa_raw_value_t, koopa_raw_value_t>&
+                  current);
+  Range widen(const Range& old_range, const Range& new_range);
+};
+
+};  // namespace KOOPA
@@ -0,0 +1,224 @@
+#include "sink.hpp"
+
+#include <utility>
+
+namespace KOOPA {
+
+// every value inst reads
+static std::vector<koopa_raw_value_t> get_uses(const koopa_raw_value_t& inst) {
+  auto& kind = inst->kind;
+  switch (kind.tag) {
+    case KOOPA_RVT_STORE:
+      return {kind.data.store.value, kind.data.store.dest};
+    case KOOPA_RVT_LOAD:
+      return {kind.data.load.src};
+    case KOOPA_RVT_BINARY:
+      return {kind.data.binary.lhs, kind.data.binary.rhs};
+    case KOOPA_RVT_GET_ELEM_PTR:
+      return {kind.data.get_elem_ptr.src, kind.data.get_elem_ptr.index};
+    case KOOPA_RVT_GET_PTR:
+      return {kind.data.get_ptr.src, kind.data.get_ptr.index};
+    case KOOPA_RVT_BRANCH:
+      return {kind.data.branch.cond};
+    case KOOPA_RVT_CALL: {
+      std::vector<koopa_raw_value_t> args;
+      for (int i = 0; i < kind.data.call.args.len; ++i) {
+        args.push_back(
+            reinterpret_cast<koopa_raw_value_t>(kind.data.call.args.buffer[i]));
+      }
+      return args;
+    }
+    case KOOPA_RVT_RETURN: {
+      if (kind.data.ret.value) {
+        return {kind.data.ret.value};
+      }
+      return {};
+    }
+    default:
+      return {};
+  }
+}
+
+void CodeSinking::run(const koopa_raw_function_t& func) {
+  sunk.clear();
+  placed.clear();
+
+  // 1. the cfg, the blocks using every value, and those loading every alloc
+  std::unordered_map<koopa_raw_basic_block_t, int> position;
+  std::unordered_map<koopa_raw_basic_block_t,
+                     std::vector<koopa_raw_basic_block_t>>
+      preds;
+  std::unordered_map<koopa_raw_value_t,
+                     std::vector<std::pair<koopa_raw_value_t,
+                                           koopa_raw_basic_block_t>>>
+      users;
+  std::unordered_map<koopa_raw_value_t, std::vector<koopa_raw_basic_block_t>>
+      loaded_in;
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    position[bb] = i;
+    for (int j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      for (auto& value : get_uses(inst)) {
+        users[value].push_back({inst, bb});
+      }
+      if (inst->kind.tag == KOOPA_RVT_LOAD) {
+        loaded_in[inst->kind.data.load.src].push_back(bb);
+      } else if (inst->kind.tag == KOOPA_RVT_JUMP) {
+        preds[inst->kind.data.jump.target].push_back(bb);
+      } else if (inst->kind.tag == KOOPA_RVT_BRANCH) {
+        preds[inst->kind.data.branch.true_bb].push_back(bb);
+        preds[inst->kind.data.branch.false_bb].push_back(bb);
+      }
+    }
+  }
+
+  /**
+   * the blocks strictly between from and to if to can only be entered
+   * through from (see above), fails otherwise
+   */
+  auto chain = [&](const koopa_raw_basic_block_t& from,
+                   const koopa_raw_basic_block_t& to,
+                   std::vector<koopa_raw_basic_block_t>& between) {
+    bool branches = false;
+    auto cur = to;
+    while (cur != from) {
+      auto& in_edges = preds[cur];
+      if (in_edges.size() != 1 || position[in_edges[0]] >= position[cur]) {
+        return false;
+      }
+      auto pred = in_edges[0];
+      auto term = reinterpret_cast<koopa_raw_value_t>(
+          pred->insts.buffer[pred->insts.len - 1]);
+      branches = branches || term->kind.tag == KOOPA_RVT_BRANCH;
+      if (pred != from) {
+        between.push_back(pred);
+      }
+      cur = pred;
+    }
+    return branches;
+  };
+
+  // 2. decide bottom-up within every block, so that chains move together
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> target;
+    for (int j = bb->insts.len - 2; j >= 0; --j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      auto tag = inst->kind.tag;
+      // the values skipped or computed on edges must stay where they are
+      if (redundancy->equivalent(inst) || redundancy->hoisted_from(inst)) {
+        continue;
+      }
+      koopa_raw_basic_block_t dest = nullptr;
+      bool valid = true;
+      auto meet = [&](const koopa_raw_basic_block_t& block) {
+        if (dest == nullptr || dest == block) {
+          dest = block;
+        } else {
+          valid = false;
+        }
+      };
+      if (tag == KOOPA_RVT_STORE) {
+        auto& ptr = inst->kind.data.store.dest;
+        if (!tracked(ptr) || loaded_in[ptr].empty()) {
+          continue;
+        }
+        for (auto& block : loaded_in[ptr]) {
+          meet(block);
+        }
+      } else if (tag == KOOPA_RVT_BINARY || tag == KOOPA_RVT_LOAD ||
+                 tag == KOOPA_RVT_GET_ELEM_PTR || tag == KOOPA_RVT_GET_PTR) {
+        for (auto& [user, block] : users[inst]) {
+          if (block != bb) {
+            meet(block);
+          } else if (target.count(user)) {
+            meet(target[user]);
+          } else {
+            valid = false;
+          }
+        }
+        for (auto& block : redundancy->referenced_in(inst)) {
+          if (block != bb) {
+            meet(block);
+          } else {
+            valid = false;
+          }
+        }
+      } else {
+        continue;
+      }
+      // an argument register may be clobbered by the time we get there
+      for (auto& value : get_uses(inst)) {
+        valid = valid && value->kind.tag != KOOPA_RVT_FUNC_ARG_REF;
+      }
+      std::vector<koopa_raw_basic_block_t> between;
+      if (!valid || dest == nullptr || dest == bb ||
+          !chain(bb, dest, between)) {
+        continue;
+      }
+      // nothing on the way may change the memory a load or store touches
+      koopa_raw_value_t ptr = nullptr;
+      if (tag == KOOPA_RVT_STORE) {
+        ptr = inst->kind.data.store.dest;
+      } else if (tag == KOOPA_RVT_LOAD) {
+        ptr = inst->kind.data.load.src;
+      }
+      if (ptr) {
+        for (int k = j + 1; k < bb->insts.len && valid; ++k) {
+          valid = !may_write(
+              reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[k]), ptr);
+        }
+        for (auto& block : between) {
+          for (int k = 0; k < block->insts.len && valid; ++k) {
+            valid = !may_write(
+                reinterpret_cast<koopa_raw_value_t>(block->insts.buffer[k]),
+                ptr);
+          }
+        }
+        if (!valid) {
+          continue;
+        }
+      }
+      target[inst] = dest;
+    }
+    for (int j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      auto it = target.find(inst);
+      if (it != target.end()) {
+        sunk.insert(inst);
+        placed[it->second].push_back(inst);
+      }
+    }
+  }
+}
+
+const std::vector<koopa_raw_value_t>& CodeSinking::sunk_into(
+    const koopa_raw_basic_block_t& bb) {
+  auto it = placed.find(bb);
+  return it == placed.end() ? no_insts : it->second;
+}
+
+// a scalar alloc only the stores to itself can change
+bool CodeSinking::tracked(const koopa_raw_value_t& ptr) {
+  if (ptr->kind.tag != KOOPA_RVT_ALLOC) {
+    return false;
+  }
+  auto base = ptr->ty->data.pointer.base;
+  return (base->tag == KOOPA_RTT_INT32 || base->tag == KOOPA_RTT_POINTER) &&
+         !alias_analysis->call_may_access(ptr);
+}
+
+bool CodeSinking::may_write(const koopa_raw_value_t& inst,
+                            const koopa_raw_value_t& ptr) {
+  if (inst->kind.tag == KOOPA_RVT_STORE) {
+    return alias_analysis->alias(inst->kind.data.store.dest, ptr) !=
+           AliasResult::NO_ALIAS;
+  }
+  if (inst->kind.tag == KOOPA_RVT_CALL) {
+    return alias_analysis->call_may_access(ptr);
+  }
+  return false;
+}
+
+};  // namespace KOOPA
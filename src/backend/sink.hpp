@@ -0,0 +1,59 @@
+#pragma once
+
+#include <koopa.h>
+#include "visitor.hpp"
+#include "alias.hpp"
+#include "pre.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace KOOPA {
+
+/**
+ * code sinking over the raw program of one function
+ *
+ * an instruction of block b whose uses all sit in one block u is computed
+ * at the start of u instead, when u can only be entered through b: every
+ * block on the way from b to u has a single predecessor, laid out after
+ * the previous one, and at least one of the steps is a conditional branch.
+ * u then runs at most as often as b (such a chain never enters a loop), and
+ * the paths leaving the chain stop paying for the value.
+ * 1. binary ops and getelemptr / getptr move freely, and so do the values
+ *    only they use, as a chain
+ * 2. a load moves if nothing on the way may write its memory (see
+ *    AliasAnalysis)
+ * 3. a store to a scalar alloc whose address never escapes moves if every
+ *    load of the alloc is in u: nothing else could see the value
+ * blocks reading the slot of a value for redundancy elimination count as
+ * uses of it.
+ */
+class CodeSinking : public Visitor {
+ public:
+  CodeSinking(AliasAnalysis* _alias_analysis,
+              RedundancyElimination* _redundancy)
+      : alias_analysis(_alias_analysis), redundancy(_redundancy) {}
+
+  void visit(const koopa_raw_function_t& func) override { run(func); }
+
+  void run(const koopa_raw_function_t& func);
+
+  bool is_sunk(const koopa_raw_value_t& inst) { return sunk.count(inst) > 0; }
+
+  // the instructions to emit at the start of bb, in their original order
+  const std::vector<koopa_raw_value_t>& sunk_into(
+      const koopa_raw_basic_block_t& bb);
+
+ private:
+  AliasAnalysis* alias_analysis;
+  RedundancyElimination* redundancy;
+  std::unordered_set<koopa_raw_value_t> sunk;
+  std::unordered_map<koopa_raw_basic_block_t, std::vector<koopa_raw_value_t>>
+      placed;
+  std::vector<koopa_raw_value_t> no_insts;
+
+  bool tracked(const koopa_raw_value_t& ptr);
+  bool may_write(const koopa_raw_value_t& inst, const koopa_raw_value_t& ptr);
+};
+
+};  // namespace KOOPA
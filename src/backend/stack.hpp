@@ -84,6 +84,11 @@ class FuncStack {
     }
   }
 
+  // value is known to equal other, let it live in the slot of other
+  void share(const koopa_raw_value_t& value, const koopa_raw_value_t& other) {
+    value_to_offset[value] = get_offset(other);
+  }
+
   bool find(const koopa_raw_value_t& value) {
     return value_to_offset.find(value) != value_to_offset.end();
   }
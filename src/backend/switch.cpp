@@ -0,0 +1,212 @@
+#include "switch.hpp"
+
+#include <algorithm>
+
+namespace KOOPA {
+
+void SwitchLowering::run(const koopa_raw_function_t& func) {
+  reset();
+
+  // 1. the number of edges entering every block
+  std::unordered_map<koopa_raw_basic_block_t, int> in_edges;
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    if (bb->insts.len == 0) {
+      continue;
+    }
+    auto term = reinterpret_cast<koopa_raw_value_t>(
+        bb->insts.buffer[bb->insts.len - 1]);
+    if (term->kind.tag == KOOPA_RVT_JUMP) {
+      in_edges[term->kind.data.jump.target] += 1;
+    } else if (term->kind.tag == KOOPA_RVT_BRANCH) {
+      in_edges[term->kind.data.branch.true_bb] += 1;
+      in_edges[term->kind.data.branch.false_bb] += 1;
+    }
+  }
+
+  // 2. follow the tests from every head
+  const int min_cases = 4;
+  for (int i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    koopa_raw_value_t key;
+    int constant;
+    koopa_raw_basic_block_t on_equal, on_differ;
+    if (folded.count(bb) ||
+        !match_test(bb, key, constant, on_equal, on_differ) ||
+        key->kind.tag != KOOPA_RVT_LOAD) {
+      continue;
+    }
+    // the key is loaded in the head, and memory stays as it is after that
+    int index = 0;
+    while (index < bb->insts.len && bb->insts.buffer[index] != key) {
+      ++index;
+    }
+    bool unchanged = index < bb->insts.len;
+    for (int j = index + 1; j < bb->insts.len && unchanged; ++j) {
+      auto tag = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j])
+                     ->kind.tag;
+      unchanged = tag != KOOPA_RVT_STORE && tag != KOOPA_RVT_CALL;
+    }
+    if (!unchanged) {
+      continue;
+    }
+
+    SwitchChain chain;
+    chain.key = key;
+    chain.cases.push_back({constant, on_equal});
+    std::vector<koopa_raw_basic_block_t> tests;
+    std::vector<std::pair<koopa_raw_basic_block_t, koopa_raw_basic_block_t>>
+        edges = {{bb, on_equal}, {bb, on_differ}};
+    auto next = on_differ;
+    koopa_raw_value_t expected, tested;
+    while (next != bb && in_edges[next] == 1 && !folded.count(next) &&
+           std::find(tests.begin(), tests.end(), next) == tests.end() &&
+           plain_test(next, key, expected) &&
+           match_test(next, tested, constant, on_equal, on_differ) &&
+           tested == expected) {
+      bool seen = false;
+      for (auto& [value, target] : chain.cases) {
+        seen = seen || value == constant;
+      }
+      if (!seen) {
+        chain.cases.push_back({constant, on_equal});
+      }
+      edges.push_back({next, on_equal});
+      edges.push_back({next, on_differ});
+      tests.push_back(next);
+      next = on_differ;
+    }
+    chain.default_bb = next;
+    if ((int)chain.cases.size() < min_cases) {
+      continue;
+    }
+
+    // control never stops on a test, so nothing may be placed on its edges
+    // or jump into it from a case
+    bool valid = true;
+    for (auto& [from, to] : edges) {
+      valid = valid && redundancy->edge_moves(from, to).empty();
+    }
+    for (auto& [value, target] : chain.cases) {
+      valid = valid &&
+              std::find(tests.begin(), tests.end(), target) == tests.end();
+    }
+    // a value of a test may only stand in for one in a later test
+    for (auto& test : tests) {
+      for (int j = 0; j < test->insts.len; ++j) {
+        auto inst = reinterpret_cast<koopa_raw_value_t>(test->insts.buffer[j]);
+        for (auto& user : redundancy->referenced_in(inst)) {
+          valid = valid &&
+                  std::find(tests.begin(), tests.end(), user) != tests.end();
+        }
+      }
+    }
+    if (!valid) {
+      continue;
+    }
+    // the tests a run goes through before it leaves the chain
+    const int max_tests_run = 2;
+    if (profile->available() && profile->block_count(bb) > 0) {
+      std::int64_t tests_run = profile->block_count(bb);
+      for (auto& test : tests) {
+        tests_run += profile->block_count(test);
+      }
+      if (tests_run <= max_tests_run * profile->block_count(bb)) {
+        continue;
+      }
+    }
+    std::sort(chain.cases.begin(), chain.cases.end(),
+              [](const std::pair<int, koopa_raw_basic_block_t>& a,
+                 const std::pair<int, koopa_raw_basic_block_t>& b) {
+                return a.first < b.first;
+              });
+    chains[bb] = std::move(chain);
+    folded.insert(tests.begin(), tests.end());
+  }
+}
+
+const SwitchChain* SwitchLowering::chain_at(
+    const koopa_raw_basic_block_t& bb) {
+  auto it = chains.find(bb);
+  return it == chains.end() ? nullptr : &it->second;
+}
+
+/**
+ * whether bb ends in a test of tested against an integer: br (eq x, c),
+ * or br x for c = 0 (x == 0 is what the false side means then)
+ */
+bool SwitchLowering::match_test(const koopa_raw_basic_block_t& bb,
+                                koopa_raw_value_t& tested, int& constant,
+                                koopa_raw_basic_block_t& on_equal,
+                                koopa_raw_basic_block_t& on_differ) {
+  if (bb->insts.len == 0) {
+    return false;
+  }
+  auto term = reinterpret_cast<koopa_raw_value_t>(
+      bb->insts.buffer[bb->insts.len - 1]);
+  if (term->kind.tag != KOOPA_RVT_BRANCH) {
+    return false;
+  }
+  auto& branch = term->kind.data.branch;
+  auto& cond = branch.cond;
+  if (cond->kind.tag == KOOPA_RVT_LOAD) {
+    tested = cond;
+    constant = 0;
+    on_equal = branch.false_bb;
+    on_differ = branch.true_bb;
+    return true;
+  }
+  if (cond->kind.tag != KOOPA_RVT_BINARY ||
+      cond->kind.data.binary.op != KOOPA_RBO_EQ) {
+    return false;
+  }
+  auto& lhs = cond->kind.data.binary.lhs;
+  auto& rhs = cond->kind.data.binary.rhs;
+  if (rhs->kind.tag == KOOPA_RVT_INTEGER) {
+    tested = lhs;
+    constant = rhs->kind.data.integer.value;
+  } else if (lhs->kind.tag == KOOPA_RVT_INTEGER) {
+    tested = rhs;
+    constant = lhs->kind.data.integer.value;
+  } else {
+    return false;
+  }
+  on_equal = branch.true_bb;
+  on_differ = branch.false_bb;
+  return tested->kind.tag != KOOPA_RVT_INTEGER;
+}
+
+/**
+ * whether bb does nothing but test the variable key was loaded from: an
+ * optional reload (tested), the comparison and the branch, none of them
+ * moved by another pass
+ */
+bool SwitchLowering::plain_test(const koopa_raw_basic_block_t& bb,
+                                const koopa_raw_value_t& key,
+                                koopa_raw_value_t& tested) {
+  if (bb->insts.len == 0 || bb->insts.len > 3 ||
+      !sinking->sunk_into(bb).empty()) {
+    return false;
+  }
+  auto term = reinterpret_cast<koopa_raw_value_t>(
+      bb->insts.buffer[bb->insts.len - 1]);
+  if (term->kind.tag != KOOPA_RVT_BRANCH) {
+    return false;
+  }
+  tested = key;
+  for (int j = 0; j < bb->insts.len - 1; ++j) {
+    auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+    if (sinking->is_sunk(inst) || redundancy->hoisted_from(inst)) {
+      return false;
+    }
+    if (inst->kind.tag == KOOPA_RVT_LOAD &&
+        inst->kind.data.load.src == key->kind.data.load.src && j == 0) {
+      tested = inst;
+    } else if (inst != term->kind.data.branch.cond) {
+      return false;
+    }
+  }
+  return true;
+}
+
+};  // namespace KOOPA
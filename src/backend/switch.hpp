@@ -0,0 +1,82 @@
+#pragma once
+
+#include <koopa.h>
+#include "visitor.hpp"
+#include "pre.hpp"
+#include "profile.hpp"
+#include "sink.hpp"
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace KOOPA {
+
+/**
+ * a chain of equality tests on one value, the way
+ * if (op == 0) ... else if (op == 1) ... else ... comes out of GenIRVisitor
+ * 1. key: the value the first test loads
+ * 2. cases: (constant, target), sorted by constant, the first test of a
+ *    constant wins
+ * 3. default_bb: where control goes when no test holds
+ */
+struct SwitchChain {
+  koopa_raw_value_t key;
+  std::vector<std::pair<int, koopa_raw_basic_block_t>> cases;
+  koopa_raw_basic_block_t default_bb;
+};
+
+/**
+ * finds the equality chains of one function worth a multiway branch
+ *
+ * the first test may sit at the end of any block (the head), after a load
+ * of some variable x. every further test is a block of its own, entered
+ * only from the previous test, that reloads x and compares it: load, eq
+ * (or a branch on x itself for x == 0) and br. nothing runs in between
+ * that could change x. the code generator dispatches at the end of the
+ * head (jump table or binary search), and never emits the other tests.
+ * a test block that other passes depend on (sunk code, edge moves) ends
+ * the chain, and one whose slots redundant values outside the chain read
+ * rules it out. with a profile, a chain that mostly stops at its first
+ * test or two is kept, that is cheaper than any dispatch.
+ */
+class SwitchLowering : public Visitor {
+ public:
+  SwitchLowering(RedundancyElimination* _redundancy, CodeSinking* _sinking,
+                 Profile* _profile)
+      : redundancy(_redundancy), sinking(_sinking), profile(_profile) {}
+
+  void visit(const koopa_raw_function_t& func) override { run(func); }
+
+  void run(const koopa_raw_function_t& func);
+
+  // no chains, every test is emitted as it is
+  void reset() {
+    chains.clear();
+    folded.clear();
+  }
+
+  // the chain whose first test ends bb, nullptr if none
+  const SwitchChain* chain_at(const koopa_raw_basic_block_t& bb);
+
+  // a test after the first one, never reached
+  bool is_folded(const koopa_raw_basic_block_t& bb) {
+    return folded.count(bb) > 0;
+  }
+
+ private:
+  RedundancyElimination* redundancy;
+  CodeSinking* sinking;
+  Profile* profile;
+  std::unordered_map<koopa_raw_basic_block_t, SwitchChain> chains;
+  std::unordered_set<koopa_raw_basic_block_t> folded;
+
+  bool match_test(const koopa_raw_basic_block_t& bb,
+                  koopa_raw_value_t& tested, int& constant,
+                  koopa_raw_basic_block_t& on_equal,
+                  koopa_raw_basic_block_t& on_differ);
+  bool plain_test(const koopa_raw_basic_block_t& bb,
+                  const koopa_raw_value_t& key, koopa_raw_value_t& tested);
+};
+
+};  // namespace KOOPA
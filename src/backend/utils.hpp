@@ -15,4 +15,16 @@ inline int get_type_width(const koopa_raw_type_t& type) {
   }
 }
 
+/**
+ * globals up to this size go to .sdata / .sbss (the -G 8 default of gcc).
+ * they are accessed with lui %hi + lw/sw %lo, which the linker relaxes into
+ * a single gp-relative lw/sw since the small data sections sit next to gp
+ */
+constexpr int kSmallDataLimit = 8;
+
+inline bool is_small_global(const koopa_raw_value_t& value) {
+  return value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC &&
+         get_type_width(value->ty->data.pointer.base) <= kSmallDataLimit;
+}
+
 };  // namespace KOOPA
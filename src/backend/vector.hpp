@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace KOOPA {
+
+/**
+ * RVV 1.0 implementations of the loop idioms recognized by GenIRVisitor
+ * with -march=rv32imv (declared as @__vec_* in the IR)
+ *
+ * all of them are vector-length agnostic: each strip asks vsetvli for as
+ * many e32 elements as remain (LMUL=4), so the same code runs on any VLEN.
+ * arguments follow the normal calling convention, pointers are *i32 and n
+ * is the element count (n <= 0 does nothing). only t0, t1, a0-a3 and
+ * vector registers are touched, all of them caller-saved.
+ */
+
+/**
+ * strip-mined loop over count_reg elements
+ * body handles the t0 elements at the current pointers, which are then
+ * advanced by t0 words. policy is "ta" for element-wise helpers and "tu"
+ * for reductions, whose accumulator must keep the lanes a short last strip
+ * doesn't cover.
+ */
+inline std::string gen_vector_strip_loop(const std::string& name,
+                                         const std::string& count_reg,
+                                         const std::vector<std::string>& ptrs,
+                                         const std::string& body,
+                                         const std::string& policy = "ta") {
+  std::string code;
+  code += "  blez " + count_reg + ", " + name + "_end\n";
+  code += name + "_loop:\n";
+  code += "  vsetvli t0, " + count_reg + ", e32, m4, " + policy + ", ma\n";
+  code += body;
+  code += "  sub " + count_reg + ", " + count_reg + ", t0\n";
+  code += "  slli t1, t0, 2\n";
+  for (auto& ptr : ptrs) {
+    code += "  add " + ptr + ", " + ptr + ", t1\n";
+  }
+  code += "  bnez " + count_reg + ", " + name + "_loop\n";
+  code += name + "_end:\n";
+  return code;
+}
+
+/**
+ * a reduction sums the lanes of the v16 accumulator into a0
+ * (vredsum.vs with a zero scalar operand)
+ */
+inline std::string gen_vector_reduction(const std::string& name,
+                                        const std::string& count_reg,
+                                        const std::vector<std::string>& ptrs,
+                                        const std::string& body) {
+  std::string code;
+  code += "  vsetvli t0, zero, e32, m4, ta, ma\n";
+  code += "  vmv.v.x v16, zero\n";
+  code += gen_vector_strip_loop(name, count_reg, ptrs, body, "tu");
+  code += "  vsetvli t0, zero, e32, m4, ta, ma\n";
+  code += "  vmv.s.x v8, zero\n";
+  code += "  vredsum.vs v8, v16, v8\n";
+  code += "  vmv.x.s a0, v8\n";
+  return code;
+}
+
+/**
+ * body of the helper called name (without '@'), empty if name is not one
+ * of them
+ */
+inline std::string gen_vector_helper(const std::string& name) {
+  std::string code;
+  if (name == "__vec_fill") {
+    // (dst, n, value)
+    code = gen_vector_strip_loop(name, "a1", {"a0"},
+                                 "  vmv.v.x v8, a2\n"
+                                 "  vse32.v v8, (a0)\n");
+  } else if (name == "__vec_copy") {
+    // (dst, src, n)
+    code = gen_vector_strip_loop(name, "a2", {"a0", "a1"},
+                                 "  vle32.v v8, (a1)\n"
+                                 "  vse32.v v8, (a0)\n");
+  } else if (name == "__vec_add" || name == "__vec_sub" ||
+             name == "__vec_mul") {
+    // (dst, x, y, n): dst[k] = x[k] op y[k]
+    code = gen_vector_strip_loop(name, "a3", {"a0", "a1", "a2"},
+                                 "  vle32.v v8, (a1)\n"
+                                 "  vle32.v v12, (a2)\n"
+                                 "  v" + name.substr(6) +
+                                     ".vv v8, v8, v12\n"
+                                     "  vse32.v v8, (a0)\n");
+  } else if (name == "__vec_addx" || name == "__vec_mulx") {
+    // (dst, x, value, n): dst[k] = x[k] op value
+    code = gen_vector_strip_loop(name, "a3", {"a0", "a1"},
+                                 "  vle32.v v8, (a1)\n"
+                                 "  v" + name.substr(6, 3) +
+                                     ".vx v8, v8, a2\n"
+                                     "  vse32.v v8, (a0)\n");
+  } else if (name == "__vec_sum") {
+    // (x, n) -> sum of x[k]
+    code = gen_vector_reduction(name, "a1", {"a0"},
+                                "  vle32.v v8, (a0)\n"
+                                "  vadd.vv v16, v16, v8\n");
+  } else if (name == "__vec_dot") {
+    // (x, y, n) -> sum of x[k] * y[k]
+    code = gen_vector_reduction(name, "a2", {"a0", "a1"},
+                                "  vle32.v v8, (a0)\n"
+                                "  vle32.v v12, (a1)\n"
+                                "  vmacc.vv v16, v8, v12\n");
+  } else {
+    return "";
+  }
+  return code + "  ret\n";
+}
+
+};  // namespace KOOPA
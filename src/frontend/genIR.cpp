@@ -1,6 +1,9 @@
 #include "genIR.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cstdint>
 #include <iostream>
 
 #include "eval.hpp"
@@ -46,6 +49,13 @@ void GenIRVisitor::visit(CompUnit& node) {
     item_ptr->accept(*this);
     item_ptr = item_ptr->next_compunit_item.get();
   }
+
+  // declare the vector helpers used, ahead of all the functions
+  std::string helper_decls;
+  for (auto& [name, decl] : vector_helpers) {
+    helper_decls += decl;
+  }
+  ir_code->insert(0, helper_decls);
 }
 
 static inline std::string get_last_ir_line(
@@ -99,6 +109,8 @@ void GenIRVisitor::visit(FuncDef& node) {
   if (node.block_item) {
     auto pruning_ret_visitor = PruningRetVisitor();
     node.block_item->accept(pruning_ret_visitor);
+    auto simplify_visitor = SimplifyVisitor();
+    simplify_visitor.visit_list(node.block_item.get());
   }
 
   // start to generate ir
@@ -112,11 +124,7 @@ void GenIRVisitor::visit(FuncDef& node) {
   }
 
   // here block_item is a list of blockitem
-  auto block_item_ptr = node.block_item.get();
-  while (block_item_ptr) {
-    block_item_ptr->accept(*this);
-    block_item_ptr = block_item_ptr->next_block_item.get();
-  }
+  visit_block_items(node.block_item.get());
   // TODO: what if the function doesn't have a return statement
   // while it has a return type of int?????????
   if (is_last_line_label(ir_code) ||
@@ -242,6 +250,36 @@ void GenIRVisitor::visit(FuncCallExp& node) {
   }
 }
 
+bool GenIRVisitor::fold_binary(const std::string& op, const std::string& lhs,
+                               const std::string& rhs) {
+  auto is_number = [](const std::string& name) {
+    return name[0] != '%' && name[0] != '@';
+  };
+  if (!is_number(lhs) || !is_number(rhs)) {
+    return false;
+  }
+  int a = std::stoi(lhs), b = std::stoi(rhs);
+  if ((op == "div" || op == "mod") &&
+      (b == 0 || (a == INT_MIN && b == -1))) {
+    return false;
+  }
+  // wrap around like the hardware does
+  unsigned ua = a, ub = b;
+  int result = op == "add"   ? (int)(ua + ub)
+               : op == "sub" ? (int)(ua - ub)
+               : op == "mul" ? (int)(ua * ub)
+               : op == "div" ? a / b
+               : op == "mod" ? a % b
+               : op == "lt"  ? a < b
+               : op == "gt"  ? a > b
+               : op == "le"  ? a <= b
+               : op == "ge"  ? a >= b
+               : op == "eq"  ? a == b
+                             : a != b;
+  push_result(std::to_string(result));
+  return true;
+}
+
 void GenIRVisitor::visit(NumberExp& node) {
   push_result(std::to_string(node.number));
 }
@@ -249,6 +287,9 @@ void GenIRVisitor::visit(NumberExp& node) {
 void GenIRVisitor::visit(NegativeExp& node) {
   node.operand->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("sub", "0", rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = sub 0, " + rhs_name + "\n");
   push_result(result_name);
@@ -257,6 +298,9 @@ void GenIRVisitor::visit(NegativeExp& node) {
 void GenIRVisitor::visit(LogicalNotExp& node) {
   node.operand->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("eq", rhs_name, "0")) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = eq " + rhs_name + ", 0\n");
   push_result(result_name);
@@ -267,6 +311,9 @@ void GenIRVisitor::visit(AddExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("add", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = add " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -278,6 +325,9 @@ void GenIRVisitor::visit(SubExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("sub", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = sub " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -289,6 +339,9 @@ void GenIRVisitor::visit(MulExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("mul", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = mul " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -300,6 +353,9 @@ void GenIRVisitor::visit(DivExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("div", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = div " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -311,6 +367,9 @@ void GenIRVisitor::visit(ModExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("mod", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = mod " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -322,6 +381,9 @@ void GenIRVisitor::visit(LTExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("lt", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = lt " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -333,6 +395,9 @@ void GenIRVisitor::visit(GTExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("gt", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = gt " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -344,6 +409,9 @@ void GenIRVisitor::visit(LEExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("le", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = le " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -355,6 +423,9 @@ void GenIRVisitor::visit(GEExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("ge", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = ge " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -366,6 +437,9 @@ void GenIRVisitor::visit(EQExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("eq", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = eq " + lhs_name + ", " + rhs_name +
                   "\n");
@@ -377,89 +451,74 @@ void GenIRVisitor::visit(NEExp& node) {
   auto lhs_name = pop_last_result();
   node.rhs->accept(*this);
   auto rhs_name = pop_last_result();
+  if (fold_binary("ne", lhs_name, rhs_name)) {
+    return;
+  }
   auto result_name = get_new_counter();
   ir_code->append("  " + result_name + " = ne " + lhs_name + ", " + rhs_name +
                   "\n");
   push_result(result_name);
 }
 
-void GenIRVisitor::visit(LAndExp& node) {
-  // node.lhs->accept(*this);
-  // auto lhs_name = pop_last_result();
-  // node.rhs->accept(*this);
-  // auto rhs_name = pop_last_result();
-  // auto result_name = get_new_counter();
-  // auto temp_l = get_new_counter();
-  // auto temp_r = get_new_counter();
-  // ir_code->append("  " + temp_l + " = ne " + lhs_name + ", 0\n");
-  // ir_code->append("  " + temp_r + " = ne " + rhs_name + ", 0\n");
-  // ir_code->append("  " + result_name + " = and " + temp_l + ", " + temp_r +
-  // "\n"); push_result(result_name);
-
-  /**
-   * short-circuit evaluation
-   */
-  int count = sym_table_stack.total_accurrences("result",
-                                                SymbolTables::SymbolKind::VAR);
-  auto result_ident_name = "@result_" + std::to_string(count + 1);
-  ir_code->append("  " + result_ident_name + " = alloc i32\n");
-  ir_code->append("  store 0, " + result_ident_name + "\n");
-  node.lhs->accept(*this);
-  auto lhs_name = pop_last_result();
-  auto tmp_1 = get_new_counter();
-  ir_code->append("  " + tmp_1 + " = ne " + lhs_name + ", 0\n");
-  auto then_label = "%then_" + std::to_string(block_label_counter);
-  auto end_label = "%end_" + std::to_string(block_label_counter);
-  block_label_counter++;
-  ir_code->append("  br " + tmp_1 + ", " + then_label + ", " + end_label +
-                  "\n");
-  ir_code->append(then_label + ":\n");
-  node.rhs->accept(*this);
-  auto rhs_name = pop_last_result();
-  auto tmp_2 = get_new_counter();
-  ir_code->append("  " + tmp_2 + " = ne " + rhs_name + ", 0\n");
-  ir_code->append("  store " + tmp_2 + ", " + result_ident_name + "\n");
-  ir_code->append("  jump " + end_label + "\n");
-  ir_code->append(end_label + ":\n");
-  auto result_name = get_new_counter();
-  ir_code->append("  " + result_name + " = load " + result_ident_name + "\n");
-  push_result(result_name);
+// x == 0 / x != 0 (T is EQExp / NEExp)
+template <typename T>
+static bool is_zero_test(Exp* exp) {
+  auto test = dynamic_cast<T*>(exp);
+  auto zero = test ? dynamic_cast<NumberExp*>(test->rhs.get()) : nullptr;
+  return zero && zero->number == 0;
 }
 
-void GenIRVisitor::visit(LOrExp& node) {
-  // node.lhs->accept(*this);
-  // auto lhs_name = pop_last_result();
-  // node.rhs->accept(*this);
-  // auto rhs_name = pop_last_result();
-  // auto temp_name = get_new_counter();
-  // auto result_name = get_new_counter();
-  // ir_code->append("  " + temp_name + " = or " + lhs_name + ", " + rhs_name +
-  // "\n"); ir_code->append("  " + result_name + " = ne " + temp_name + ",
-  // 0\n"); push_result(result_name);
+void GenIRVisitor::gen_cond(Exp* exp, const std::string& true_label,
+                            const std::string& false_label) {
+  if (auto land = dynamic_cast<LAndExp*>(exp)) {
+    // lhs false -> whole exp false, otherwise test rhs
+    auto rhs_label = "%land_rhs_" + std::to_string(block_label_counter);
+    block_label_counter++;
+    gen_cond(land->lhs.get(), rhs_label, false_label);
+    ir_code->append(rhs_label + ":\n");
+    gen_cond(land->rhs.get(), true_label, false_label);
+  } else if (auto lor = dynamic_cast<LOrExp*>(exp)) {
+    // lhs true -> whole exp true, otherwise test rhs
+    auto rhs_label = "%lor_rhs_" + std::to_string(block_label_counter);
+    block_label_counter++;
+    gen_cond(lor->lhs.get(), true_label, rhs_label);
+    ir_code->append(rhs_label + ":\n");
+    gen_cond(lor->rhs.get(), true_label, false_label);
+  } else if (auto lnot = dynamic_cast<LogicalNotExp*>(exp)) {
+    gen_cond(lnot->operand.get(), false_label, true_label);
+  } else if (is_zero_test<NEExp>(exp)) {
+    // x != 0 is what a branch on x tests anyway
+    gen_cond(static_cast<NEExp*>(exp)->lhs.get(), true_label, false_label);
+  } else if (is_zero_test<EQExp>(exp)) {
+    gen_cond(static_cast<EQExp*>(exp)->lhs.get(), false_label, true_label);
+  } else {
+    exp->accept(*this);
+    auto cond_name = pop_last_result();
+    if (cond_name[0] != '%' && cond_name[0] != '@') {
+      // constant condition, only one target is reachable
+      auto target = std::stoi(cond_name) != 0 ? true_label : false_label;
+      ir_code->append("  jump " + target + "\n");
+    } else {
+      ir_code->append("  br " + cond_name + ", " + true_label + ", " +
+                      false_label + "\n");
+    }
+  }
+}
 
-  /**
-   * short-circuit evaluation
-   */
-  int count = sym_table_stack.total_accurrences("result",
-                                                SymbolTables::SymbolKind::VAR);
-  auto result_ident_name = "@result_" + std::to_string(count + 1);
+void GenIRVisitor::gen_logical_value(Exp* exp) {
+  auto suffix = std::to_string(block_label_counter);
+  block_label_counter++;
+  auto true_label = "%cond_true_" + suffix;
+  auto false_label = "%cond_false_" + suffix;
+  auto end_label = "%cond_end_" + suffix;
+  auto result_ident_name = get_new_counter("result_");
   ir_code->append("  " + result_ident_name + " = alloc i32\n");
+  gen_cond(exp, true_label, false_label);
+  ir_code->append(true_label + ":\n");
   ir_code->append("  store 1, " + result_ident_name + "\n");
-  node.lhs->accept(*this);
-  auto lhs_name = pop_last_result();
-  auto tmp_1 = get_new_counter();
-  ir_code->append("  " + tmp_1 + " = eq " + lhs_name + ", 0\n");
-  auto then_label = "%then_" + std::to_string(block_label_counter);
-  auto end_label = "%end_" + std::to_string(block_label_counter);
-  block_label_counter++;
-  ir_code->append("  br " + tmp_1 + ", " + then_label + ", " + end_label +
-                  "\n");
-  ir_code->append(then_label + ":\n");
-  node.rhs->accept(*this);
-  auto rhs_name = pop_last_result();
-  auto tmp_2 = get_new_counter();
-  ir_code->append("  " + tmp_2 + " = ne " + rhs_name + ", 0\n");
-  ir_code->append("  store " + tmp_2 + ", " + result_ident_name + "\n");
+  ir_code->append("  jump " + end_label + "\n");
+  ir_code->append(false_label + ":\n");
+  ir_code->append("  store 0, " + result_ident_name + "\n");
   ir_code->append("  jump " + end_label + "\n");
   ir_code->append(end_label + ":\n");
   auto result_name = get_new_counter();
@@ -467,6 +526,10 @@ void GenIRVisitor::visit(LOrExp& node) {
   push_result(result_name);
 }
 
+void GenIRVisitor::visit(LAndExp& node) { gen_logical_value(&node); }
+
+void GenIRVisitor::visit(LOrExp& node) { gen_logical_value(&node); }
+
 void GenIRVisitor::visit(ConstDecl& node) {
   std::cout << "genir visit constdecl" << std::endl;
   auto const_def_ptr = node.const_def.get();
@@ -601,58 +664,16 @@ void GenIRVisitor::visit(AssignStmt& node) {
   if (kind == SymbolTables::SymbolKind::VAR) {
     var_name = std::get<std::string>(
         sym_table_stack.get(node.lval->ident, SymbolTables::SymbolKind::VAR));
-  } else if (kind == SymbolTables::SymbolKind::VAR_ARR) {
-    // node.lval->accept(*this);
-    /**
-     * here we only need to get a ptr of the value in array, so we cannot visit
-     * lval directly for example: %ptr1 = getelemptr @arr, %0 %ptr2 = getelemptr
-     * %ptr1, %1 is enough
-     */
-    auto arr_sym_name = std::get<std::string>(sym_table_stack.get(
-        node.lval->ident, SymbolTables::SymbolKind::VAR_ARR));
-    auto index_ptr = node.lval->array_dims.get();
-    assert(index_ptr != nullptr);
-    std::stack<std::string> ptr_stack;
-    ptr_stack.push(arr_sym_name);
-    while (index_ptr) {
-      // index_ptr->exp
-      assert(index_ptr->exp != nullptr);
-      index_ptr->exp->accept(*this);
-      auto index_name = pop_last_result();
-      auto rptr_name = ptr_stack.top();
-      ptr_stack.pop();
-      auto lptr_name = get_new_counter();
-      ir_code->append("  " + lptr_name + " = getelemptr " + rptr_name + ", " +
-                      index_name + "\n");
-      ptr_stack.push(lptr_name);
-      index_ptr = index_ptr->next_dim.get();
-    }
-    var_name = ptr_stack.top();
-  } else if (kind == SymbolTables::SymbolKind::PTR) {
-    // similar to VAR_ARR, we just don't need to load ptr at last compared to
-    // lval
-    auto sym_name = std::get<std::string>(
-        sym_table_stack.get(node.lval->ident, SymbolTables::SymbolKind::PTR));
-    auto tmp_0 = get_new_counter();
-    ir_code->append("  " + tmp_0 + " = load " + sym_name + "\n");
-    auto tmp_1 = get_new_counter();
-    auto ptr = node.lval->array_dims.get();
-    assert(ptr != nullptr);
-    ptr->exp->accept(*this);
-    auto array_offset = pop_last_result();
-    ir_code->append("  " + tmp_1 + " = getptr " + tmp_0 + ", " + array_offset +
-                    "\n");
-    ptr = ptr->next_dim.get();
-    while (ptr) {
-      auto tmp_2 = get_new_counter();
-      ptr->exp->accept(*this);
-      auto array_offset = pop_last_result();
-      ir_code->append("  " + tmp_2 + " = getelemptr " + tmp_1 + ", " +
-                      array_offset + "\n");
-      tmp_1 = tmp_2;
-      ptr = ptr->next_dim.get();
-    }
-    var_name = tmp_1;
+  } else if (kind == SymbolTables::SymbolKind::VAR_ARR &&
+             !sym_table_stack.get_var_arr_info(node.lval->ident)
+                  .scalars.empty()) {
+    gen_scalar_elem_store(*node.lval,
+                          sym_table_stack.get_var_arr_info(node.lval->ident),
+                          node.exp.get());
+    return;
+  } else if (kind == SymbolTables::SymbolKind::VAR_ARR ||
+             kind == SymbolTables::SymbolKind::PTR) {
+    var_name = gen_elem_ptr(*node.lval);
   } else {
     throw std::runtime_error("undefined var symbol: " + node.lval->ident);
   }
@@ -663,6 +684,207 @@ void GenIRVisitor::visit(AssignStmt& node) {
   node.exp->accept(*this);
   auto store_counter_name = pop_last_result();
   ir_code->append("  store " + store_counter_name + ", " + var_name + "\n");
+  for (auto& ref : carried_refs) {
+    if (ref.store == &node) {
+      ir_code->append("  store " + store_counter_name + ", " + ref.carry_name +
+                      "\n");
+    }
+  }
+}
+
+std::string GenIRVisitor::gen_elem_ptr(LValExp& lval) {
+  /**
+   * here we only need to get a ptr of the value in array, so we cannot visit
+   * lval directly
+   * 1. array: %ptr1 = getelemptr @arr, %0 %ptr2 = getelemptr %ptr1, %1
+   * 2. ptr: similar, we just don't need to load ptr at last compared to lval
+   */
+  auto kind = sym_table_stack.find(lval.ident);
+  auto index_ptr = lval.array_dims.get();
+  assert(index_ptr != nullptr);
+  std::string ptr_name;
+  if (kind == SymbolTables::SymbolKind::VAR_ARR) {
+    ptr_name = std::get<std::string>(
+        sym_table_stack.get(lval.ident, SymbolTables::SymbolKind::VAR_ARR));
+  } else if (kind == SymbolTables::SymbolKind::PTR) {
+    auto sym_name = sym_table_stack.get_ptr_info(lval.ident).sym_name;
+    auto tmp_0 = get_new_counter();
+    ir_code->append("  " + tmp_0 + " = load " + sym_name + "\n");
+    index_ptr->exp->accept(*this);
+    auto array_offset = pop_last_result();
+    ptr_name = get_new_counter();
+    ir_code->append("  " + ptr_name + " = getptr " + tmp_0 + ", " +
+                    array_offset + "\n");
+    index_ptr = index_ptr->next_dim.get();
+  } else {
+    throw std::runtime_error("not an array: " + lval.ident);
+  }
+  while (index_ptr) {
+    assert(index_ptr->exp != nullptr);
+    index_ptr->exp->accept(*this);
+    auto index_name = pop_last_result();
+    auto lptr_name = get_new_counter();
+    ir_code->append("  " + lptr_name + " = getelemptr " + ptr_name + ", " +
+                    index_name + "\n");
+    ptr_name = lptr_name;
+    index_ptr = index_ptr->next_dim.get();
+  }
+  return ptr_name;
+}
+
+bool GenIRVisitor::gen_scalar_replaced_array(
+    VarDef& node, const std::vector<int>& shape,
+    const std::vector<std::variant<Exp*, int>>& data) {
+  int size = data.size();
+  if (size > kScalarReplaceMaxElems || block_items.empty() ||
+      block_items.back().empty()) {
+    return false;
+  }
+  auto decl = dynamic_cast<VarDecl*>(block_items.back().back());
+  if (decl == nullptr) {
+    return false;
+  }
+  // 1. the uses: initializers of the later defs of this declaration, then
+  // the rest of the block
+  auto uses = ArrayUseVisitor(&sym_table_stack, node.ident, shape,
+                              kFullUnrollMaxTrips, kUnrollBudget);
+  uses.visit_rest(node.next_var_def.get(), decl->next_block_item.get(),
+                  block_items.back());
+  if (!uses.replaceable || uses.dynamic > 0) {
+    return false;
+  }
+  std::cout << "genir scalar replace array " << node.ident << " (" << size
+            << " elements)" << std::endl;
+
+  // 2. one scalar per element, then the initial values in order
+  auto sym_name = std::get<std::string>(
+      sym_table_stack.get(node.ident, SymbolTables::SymbolKind::VAR_ARR));
+  std::vector<std::string> scalars;
+  for (int k = 0; k < size; ++k) {
+    scalars.push_back(sym_name + "_e" + std::to_string(k));
+    ir_code->append("  " + scalars.back() + " = alloc i32\n");
+  }
+  sym_table_stack.set_var_arr_scalars(node.ident, scalars);
+  for (int k = 0; k < size; ++k) {
+    std::string value;
+    if (data[k].index() == 0) {
+      std::get<Exp*>(data[k])->accept(*this);
+      value = pop_last_result();
+    } else {
+      value = std::to_string(std::get<int>(data[k]));
+    }
+    ir_code->append("  store " + value + ", " + scalars[k] + "\n");
+  }
+  return true;
+}
+
+std::string GenIRVisitor::gen_flat_index(LValExp& lval,
+                                         const std::vector<int>& dims,
+                                         bool& is_const) {
+  // 1. all indices constant
+  int flat = 0;
+  is_const = true;
+  int layer = 0;
+  for (auto dim = lval.array_dims.get(); dim; dim = dim->next_dim.get()) {
+    try {
+      EvaluateVisitor evaluator(&sym_table_stack);
+      dim->exp->accept(evaluator);
+      flat = flat * dims[layer] + evaluator.result;
+    } catch (std::runtime_error& e) {
+      is_const = false;
+      break;
+    }
+    layer++;
+  }
+  if (is_const) {
+    return std::to_string(flat);
+  }
+  // 2. computed at runtime, ((i0 * d1) + i1) * d2 + i2 ...
+  std::string flat_name;
+  layer = 0;
+  for (auto dim = lval.array_dims.get(); dim; dim = dim->next_dim.get()) {
+    dim->exp->accept(*this);
+    auto index_name = pop_last_result();
+    if (layer == 0) {
+      flat_name = index_name;
+    } else {
+      auto mul_name = get_new_counter();
+      ir_code->append("  " + mul_name + " = mul " + flat_name + ", " +
+                      std::to_string(dims[layer]) + "\n");
+      flat_name = get_new_counter();
+      ir_code->append("  " + flat_name + " = add " + mul_name + ", " +
+                      index_name + "\n");
+    }
+    layer++;
+  }
+  return flat_name;
+}
+
+void GenIRVisitor::gen_scalar_elem_load(LValExp& lval,
+                                        const SymbolTables::VarArrInfo& info) {
+  bool is_const;
+  auto index = gen_flat_index(lval, info.dims, is_const);
+  int size = info.scalars.size();
+  if (is_const) {
+    // ArrayUseVisitor keeps arrays with a constant index out of range
+    int k = std::stoi(index);
+    assert(k >= 0 && k < size);
+    auto result_name = get_new_counter();
+    ir_code->append("  " + result_name + " = load " + info.scalars[k] + "\n");
+    push_result(result_name);
+    return;
+  }
+  // sum of (index == k) * a_k over all elements
+  std::string sum_name = "0";
+  for (int k = 0; k < size; ++k) {
+    auto eq_name = get_new_counter();
+    ir_code->append("  " + eq_name + " = eq " + index + ", " +
+                    std::to_string(k) + "\n");
+    auto elem_name = get_new_counter();
+    ir_code->append("  " + elem_name + " = load " + info.scalars[k] + "\n");
+    auto mul_name = get_new_counter();
+    ir_code->append("  " + mul_name + " = mul " + eq_name + ", " + elem_name +
+                    "\n");
+    auto add_name = get_new_counter();
+    ir_code->append("  " + add_name + " = add " + sum_name + ", " + mul_name +
+                    "\n");
+    sum_name = add_name;
+  }
+  push_result(sum_name);
+}
+
+void GenIRVisitor::gen_scalar_elem_store(LValExp& lval,
+                                         const SymbolTables::VarArrInfo& info,
+                                         Exp* exp) {
+  bool is_const;
+  auto index = gen_flat_index(lval, info.dims, is_const);
+  exp->accept(*this);
+  auto value = pop_last_result();
+  int size = info.scalars.size();
+  if (is_const) {
+    int k = std::stoi(index);
+    assert(k >= 0 && k < size);
+    ir_code->append("  store " + value + ", " + info.scalars[k] + "\n");
+    return;
+  }
+  // a_k = a_k + (index == k) * (value - a_k) for all elements
+  for (int k = 0; k < size; ++k) {
+    auto eq_name = get_new_counter();
+    ir_code->append("  " + eq_name + " = eq " + index + ", " +
+                    std::to_string(k) + "\n");
+    auto elem_name = get_new_counter();
+    ir_code->append("  " + elem_name + " = load " + info.scalars[k] + "\n");
+    auto diff_name = get_new_counter();
+    ir_code->append("  " + diff_name + " = sub " + value + ", " + elem_name +
+                    "\n");
+    auto mul_name = get_new_counter();
+    ir_code->append("  " + mul_name + " = mul " + eq_name + ", " + diff_name +
+                    "\n");
+    auto add_name = get_new_counter();
+    ir_code->append("  " + add_name + " = add " + elem_name + ", " + mul_name +
+                    "\n");
+    ir_code->append("  store " + add_name + ", " + info.scalars[k] + "\n");
+  }
 }
 
 void GenIRVisitor::visit(ExpStmt& node) {
@@ -679,25 +901,119 @@ void GenIRVisitor::visit(BlockStmt& node) {
   std::cout << "genir visit blockstmt" << std::endl;
 
   sym_table_stack.push_table();
-  auto block_item_ptr = node.block_item.get();
-  while (block_item_ptr) {
-    block_item_ptr->accept(*this);
-    block_item_ptr = block_item_ptr->next_block_item.get();
-  }
+  visit_block_items(node.block_item.get());
   sym_table_stack.pop_table();
 }
 
-void GenIRVisitor::visit(IfStmt& node) {
-  std::cout << "genir visit ifstmt" << std::endl;
+void GenIRVisitor::visit_block_items(BlockItem* item, BlockItem* stop) {
+  block_items.emplace_back();
+  while (item && item != stop) {
+    block_items.back().push_back(item);
+    item->accept(*this);
+    item = item->next_block_item.get();
+  }
+  block_items.pop_back();
+}
+
+// the only assignment of an if arm, either bare or wrapped in a block
+static AssignStmt* get_single_assign(Stmt* stmt) {
+  if (auto block = dynamic_cast<BlockStmt*>(stmt)) {
+    if (block->block_item == nullptr ||
+        block->block_item->next_block_item != nullptr) {
+      return nullptr;
+    }
+    return dynamic_cast<AssignStmt*>(block->block_item.get());
+  }
+  return dynamic_cast<AssignStmt*>(stmt);
+}
+
+bool GenIRVisitor::gen_select(IfStmt& node) {
+  auto then_assign = get_single_assign(node.then_body.get());
+  if (then_assign == nullptr || then_assign->lval->array_dims) {
+    return false;
+  }
+  auto& ident = then_assign->lval->ident;
+  if (sym_table_stack.find(ident) != SymbolTables::SymbolKind::VAR) {
+    return false;
+  }
+  Exp* else_exp = then_assign->lval.get();  // no else: keep the old value
+  if (node.else_body) {
+    auto else_assign = get_single_assign(node.else_body.get());
+    if (else_assign == nullptr || else_assign->lval->array_dims ||
+        else_assign->lval->ident != ident) {
+      return false;
+    }
+    else_exp = else_assign->exp.get();
+  }
+
+  auto cond_loads = CondLoadsVisitor();
+  node.cond->accept(cond_loads);
+  if (cond_loads.has_short_circuit) {
+    return false;
+  }
+  // a one-armed if whose condition doesn't read memory is usually driven by
+  // loop counters and well predicted, keep the branch and skip the extra work
+  if (node.else_body == nullptr && cond_loads.loads.empty()) {
+    return false;
+  }
+  auto safety = SelectSafetyVisitor();
+  safety.evaluated_loads = cond_loads.loads;
+  then_assign->exp->accept(safety);
+  else_exp->accept(safety);
+  if (!safety.safe || safety.cost > kSelectBudget) {
+    return false;
+  }
+
+  std::cout << "genir if-conversion on " << ident << std::endl;
   node.cond->accept(*this);
   auto cond_name = pop_last_result();
+  auto cond_exp = node.cond.get();
+  bool is_bool = dynamic_cast<LTExp*>(cond_exp) ||
+                 dynamic_cast<GTExp*>(cond_exp) ||
+                 dynamic_cast<LEExp*>(cond_exp) ||
+                 dynamic_cast<GEExp*>(cond_exp) ||
+                 dynamic_cast<EQExp*>(cond_exp) ||
+                 dynamic_cast<NEExp*>(cond_exp) ||
+                 dynamic_cast<LogicalNotExp*>(cond_exp);
+  if (!is_bool) {
+    auto bool_name = get_new_counter();
+    ir_code->append("  " + bool_name + " = ne " + cond_name + ", 0\n");
+    cond_name = bool_name;
+  }
+  then_assign->exp->accept(*this);
+  auto then_name = pop_last_result();
+  else_exp->accept(*this);
+  auto else_name = pop_last_result();
+
+  // mask is all ones when cond holds, so x = else + (then - else)
+  auto diff_name = get_new_counter();
+  auto mask_name = get_new_counter();
+  auto masked_name = get_new_counter();
+  auto result_name = get_new_counter();
+  ir_code->append("  " + diff_name + " = sub " + then_name + ", " +
+                  else_name + "\n");
+  ir_code->append("  " + mask_name + " = sub 0, " + cond_name + "\n");
+  ir_code->append("  " + masked_name + " = and " + diff_name + ", " +
+                  mask_name + "\n");
+  ir_code->append("  " + result_name + " = add " + else_name + ", " +
+                  masked_name + "\n");
+  auto var_name = std::get<std::string>(
+      sym_table_stack.get(ident, SymbolTables::SymbolKind::VAR));
+  ir_code->append("  store " + result_name + ", " + var_name + "\n");
+  return true;
+}
+
+void GenIRVisitor::visit(IfStmt& node) {
+  std::cout << "genir visit ifstmt" << std::endl;
+  if (gen_select(node)) {
+    return;
+  }
   if (node.else_body) {
     auto then_label = "%then_" + std::to_string(block_label_counter);
     auto else_label = "%else_" + std::to_string(block_label_counter);
     auto end_label = "%end_" + std::to_string(block_label_counter);
     block_label_counter++;
-    ir_code->append("  br " + cond_name + ", " + then_label + ", " +
-                    else_label + "\n");
+    gen_cond(node.cond.get(), then_label, else_label);
 
     // handle then_body
     ir_code->append(then_label + ":\n");
@@ -733,8 +1049,7 @@ void GenIRVisitor::visit(IfStmt& node) {
     auto then_label = "%then_" + std::to_string(block_label_counter);
     auto end_label = "%end_" + std::to_string(block_label_counter);
     block_label_counter++;
-    ir_code->append("  br " + cond_name + ", " + then_label + ", " + end_label +
-                    "\n");
+    gen_cond(node.cond.get(), then_label, end_label);
 
     // handle then_body
     ir_code->append(then_label + ":\n");
@@ -750,27 +1065,1066 @@ void GenIRVisitor::visit(IfStmt& node) {
   }
 }
 
+std::vector<BlockItem*> GenIRVisitor::preceding_items(Stmt& node) {
+  if (block_items.empty() || block_items.back().empty() ||
+      block_items.back().back() != &node) {
+    return {};
+  }
+  auto& items = block_items.back();
+  return std::vector<BlockItem*>(items.begin(), items.end() - 1);
+}
+
+bool GenIRVisitor::gen_closed_form(WhileStmt& node) {
+  auto scev = ScalarEvolution(&sym_table_stack);
+  auto info = scev.analyze(node, preceding_items(node));
+  if (!info.is_counted || !info.iv.known_start ||
+      info.items.size() != info.recurrences.size() + 1 ||
+      !info.body.declared.empty() || !scev.trip_count_fits(info)) {
+    return false;
+  }
+  std::cout << "genir closed form for loop on " << info.iv.ident << std::endl;
+
+  auto emit = [&](const std::string& op, const std::string& lhs,
+                  const std::string& rhs) {
+    auto name = get_new_counter();
+    ir_code->append("  " + name + " = " + op + " " + lhs + ", " + rhs + "\n");
+    return name;
+  };
+  auto var_name = [&](const std::string& ident) {
+    return std::get<std::string>(
+        sym_table_stack.get(ident, SymbolTables::SymbolKind::VAR));
+  };
+  auto load = [&](const std::string& ident) {
+    auto name = get_new_counter();
+    ir_code->append("  " + name + " = load " + var_name(ident) + "\n");
+    return name;
+  };
+
+  // 1. trip count t
+  auto start_name = std::to_string(info.iv.start);
+  std::string bound_name;
+  if (info.const_bound) {
+    bound_name = std::to_string(info.bound);
+  } else {
+    info.bound_exp->accept(*this);
+    bound_name = pop_last_result();
+  }
+  auto trips = scev.gen_trip_count(info, start_name, bound_name, emit);
+
+  // 2. t * (t - 1) / 2
+  auto trips_m1 = emit("sub", trips, "1");
+  auto tri = emit("mul", emit("div", trips, "2"), trips_m1);
+  tri = emit("add", tri,
+             emit("mul", emit("mod", trips, "2"), emit("div", trips_m1, "2")));
+
+  // 3. final values, computed from the values before the loop
+  std::vector<std::pair<std::string, std::string>> finals;
+  for (auto& rec : info.recurrences) {
+    auto init = load(rec.ident);
+    std::string delta;
+    if (rec.step_rec.empty()) {
+      rec.step_exp->accept(*this);
+      delta = emit("mul", trips, pop_last_result());
+    } else {
+      const AddRecurrence* base = &info.iv;
+      for (auto& other : info.recurrences) {
+        if (other.ident == rec.step_rec) {
+          base = &other;
+        }
+      }
+      auto base_init = base == &info.iv ? start_name : load(base->ident);
+      std::string base_step;
+      if (base->const_step) {
+        base_step = std::to_string(base->step);
+      } else {
+        base->step_exp->accept(*this);
+        base_step = pop_last_result();
+        if (base->negate) {
+          base_step = emit("sub", "0", base_step);
+        }
+      }
+      auto count = tri;
+      if (base->update_index < rec.update_index) {
+        count = emit("add", tri, trips);
+      }
+      delta = emit("add", emit("mul", trips, base_init),
+                   emit("mul", base_step, count));
+    }
+    finals.push_back({rec.ident, emit(rec.negate ? "sub" : "add", init, delta)});
+  }
+  auto iv_final = emit("add", start_name,
+                       emit("mul", trips, std::to_string(info.iv.step)));
+  finals.push_back({info.iv.ident, iv_final});
+  for (auto& [ident, value] : finals) {
+    ir_code->append("  store " + value + ", " + var_name(ident) + "\n");
+  }
+  return true;
+}
+
+bool GenIRVisitor::gen_unrolled_loop(WhileStmt& node) {
+  auto scev = ScalarEvolution(&sym_table_stack);
+  auto info = scev.analyze(node, preceding_items(node));
+  // only innermost loops, unrolling a nest multiplies the code size
+  if (!info.is_counted || info.body.has_loop) {
+    return false;
+  }
+  auto& ident = info.iv.ident;
+  auto& op = info.op;
+  auto var_name = std::get<std::string>(
+      sym_table_stack.get(ident, SymbolTables::SymbolKind::VAR));
+  int body_cost = std::max(info.body.cost, 1);
+  auto body = static_cast<BlockStmt*>(node.body.get());
+  // every literal the unrolled code holds has to be an i32
+  auto fits = [](long long value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+  };
+
+  // 1. full unrolling
+  if (scev.is_fully_unrolled(info, kFullUnrollMaxTrips, kUnrollBudget)) {
+    long long trips = info.trip_count, start = info.iv.start;
+    long long step = info.iv.step;
+    std::cout << "genir fully unroll loop on " << ident << " (" << trips
+              << " trips)" << std::endl;
+    for (int k = 0; k < trips; ++k) {
+      sym_table_stack.push_table();
+      sym_table_stack.insert_to_top(ident, (int)(start + k * step));
+      visit_block_items(body->block_item.get(), info.iv_update);
+      sym_table_stack.pop_table();
+    }
+    ir_code->append("  store " + std::to_string(start + trips * step) + ", " +
+                    var_name + "\n");
+    return true;
+  }
+
+  // 2. partial unrolling, the main loop runs while
+  // i op bound - (factor - 1) * step, i.e. while factor more trips remain.
+  // a bound so close to the end of the int range that this wraps around
+  // leaves fewer trips than that, the main loop is skipped then (checked
+  // on entry, the bound doesn't change).
+  int factor = kUnrollFactor;
+  while (factor > 1 && body_cost * factor > kUnrollBudget) {
+    factor /= 2;
+  }
+  if (factor < 2) {
+    return false;
+  }
+  long long adjust = (long long)(factor - 1) * info.iv.step;
+  long long bound = info.bound;
+  if (!fits(adjust) || (info.const_bound && !fits(bound - adjust)) ||
+      (!info.const_bound &&
+       !fits(adjust > 0 ? INT32_MIN + adjust : INT32_MAX + adjust))) {
+    return false;
+  }
+  std::cout << "genir unroll loop on " << ident << " by " << factor
+            << std::endl;
+  auto suffix = std::to_string(block_label_counter);
+  block_label_counter++;
+  auto unroll_body_name = "%unroll_body_" + suffix;
+  auto unroll_end_name = "%unroll_end_" + suffix;
+  auto gen_main_cond = [&](bool entry) {
+    std::string bound_name, fits_name;
+    if (info.const_bound) {
+      bound_name = std::to_string(bound - adjust);
+    } else {
+      info.bound_exp->accept(*this);
+      auto rhs_name = pop_last_result();
+      bound_name = get_new_counter();
+      ir_code->append("  " + bound_name + " = sub " + rhs_name + ", " +
+                      std::to_string(adjust) + "\n");
+      if (entry) {
+        fits_name = get_new_counter();
+        auto limit = adjust > 0 ? "ge " + rhs_name + ", " +
+                                      std::to_string(INT32_MIN + adjust)
+                                : "le " + rhs_name + ", " +
+                                      std::to_string(INT32_MAX + adjust);
+        ir_code->append("  " + fits_name + " = " + limit + "\n");
+      }
+    }
+    auto iv_name = get_new_counter();
+    ir_code->append("  " + iv_name + " = load " + var_name + "\n");
+    auto cond_name = get_new_counter();
+    ir_code->append("  " + cond_name + " = " + op + " " + iv_name + ", " +
+                    bound_name + "\n");
+    if (!fits_name.empty()) {
+      auto both_name = get_new_counter();
+      ir_code->append("  " + both_name + " = and " + fits_name + ", " +
+                      cond_name + "\n");
+      cond_name = both_name;
+    }
+    ir_code->append("  br " + cond_name + ", " + unroll_body_name + ", " +
+                    unroll_end_name + "\n");
+  };
+  gen_main_cond(true);
+  ir_code->append(unroll_body_name + ":\n");
+  for (int k = 0; k < factor; ++k) {
+    node.body->accept(*this);
+  }
+  gen_main_cond(false);
+  ir_code->append(unroll_end_name + ":\n");
+  // remainder
+  gen_rotated_loop(node);
+  return true;
+}
+
+bool GenIRVisitor::gen_vectorized_loop(WhileStmt& node) {
+  auto scev = ScalarEvolution(&sym_table_stack);
+  auto info = scev.analyze(node, preceding_items(node));
+  if (!info.is_counted || info.iv.step != 1 || info.items.size() != 2 ||
+      info.body.has_call || info.body.has_loop ||
+      !info.body.declared.empty() || !scev.trip_count_fits(info)) {
+    return false;
+  }
+  if (info.const_trip_count && info.trip_count < kVectorMinTrips) {
+    return false;
+  }
+  auto assign = dynamic_cast<AssignStmt*>(info.items[0]);
+  if (assign == nullptr) {
+    return false;
+  }
+  auto& iv = info.iv.ident;
+
+  // a[..][i] with invariant leading indices, addressing an i32
+  auto as_stream = [&](Exp* exp) -> LValExp* {
+    auto lval = dynamic_cast<LValExp*>(exp);
+    if (lval == nullptr || lval->array_dims == nullptr) {
+      return nullptr;
+    }
+    auto kind = sym_table_stack.find(lval->ident);
+    int array_dim;
+    if (kind == SymbolTables::SymbolKind::VAR_ARR) {
+      auto arr_info = sym_table_stack.get_var_arr_info(lval->ident);
+      if (!arr_info.scalars.empty()) {
+        return nullptr;  // no memory behind it
+      }
+      array_dim = arr_info.dims.size();
+    } else if (kind == SymbolTables::SymbolKind::PTR) {
+      array_dim = sym_table_stack.get_ptr_info(lval->ident).dims;
+    } else {
+      return nullptr;
+    }
+    int refer_dim = 0;
+    auto dim = lval->array_dims.get();
+    for (; dim->next_dim; dim = dim->next_dim.get()) {
+      if (!scev.is_invariant(dim->exp.get(), info.body)) {
+        return nullptr;
+      }
+      refer_dim += 1;
+    }
+    auto index = dynamic_cast<LValExp*>(dim->exp.get());
+    if (refer_dim + 1 != array_dim || index == nullptr ||
+        index->array_dims || index->ident != iv) {
+      return nullptr;
+    }
+    return lval;
+  };
+  auto is_local_array = [&](LValExp* lval) {
+    return sym_table_stack.find(lval->ident) ==
+           SymbolTables::SymbolKind::VAR_ARR;
+  };
+
+  // 1. match the idiom
+  std::string helper;
+  LValExp* dst = nullptr;
+  std::vector<LValExp*> srcs;
+  Exp* value = nullptr;  // the invariant operand
+  bool negate = false;
+  if (assign->lval->array_dims) {
+    dst = as_stream(assign->lval.get());
+    if (dst == nullptr) {
+      return false;
+    }
+    auto exp = assign->exp.get();
+    auto binary = dynamic_cast<BinaryExp*>(exp);
+    bool add = dynamic_cast<AddExp*>(exp), sub = dynamic_cast<SubExp*>(exp),
+         mul = dynamic_cast<MulExp*>(exp);
+    if (auto src = as_stream(exp)) {
+      helper = "__vec_copy";
+      srcs = {src};
+    } else if (scev.is_invariant(exp, info.body)) {
+      helper = "__vec_fill";
+      value = exp;
+    } else if (add || sub || mul) {
+      auto lhs = as_stream(binary->lhs.get());
+      auto rhs = as_stream(binary->rhs.get());
+      auto op = add ? "add" : sub ? "sub" : "mul";
+      if (lhs && rhs) {
+        helper = std::string("__vec_") + op;
+        srcs = {lhs, rhs};
+      } else if (lhs && scev.is_invariant(binary->rhs.get(), info.body)) {
+        // b[i] - e is b[i] + (-e)
+        helper = mul ? "__vec_mulx" : "__vec_addx";
+        srcs = {lhs};
+        value = binary->rhs.get();
+        negate = sub;
+      } else if (rhs && !sub &&
+                 scev.is_invariant(binary->lhs.get(), info.body)) {
+        helper = mul ? "__vec_mulx" : "__vec_addx";
+        srcs = {rhs};
+        value = binary->lhs.get();
+      } else {
+        return false;
+      }
+    } else {
+      return false;
+    }
+    for (auto src : srcs) {
+      bool no_alias = src->ident == dst->ident
+                          ? same_exp(src, dst)
+                          : is_local_array(src) && is_local_array(dst);
+      if (!no_alias) {
+        return false;
+      }
+    }
+  } else {
+    // x = x + r or x = r + x
+    auto& ident = assign->lval->ident;
+    auto add = dynamic_cast<AddExp*>(assign->exp.get());
+    if (ident == iv || !scev.is_scalar_var(ident) || add == nullptr) {
+      return false;
+    }
+    auto is_self = [&](Exp* exp) {
+      auto lval = dynamic_cast<LValExp*>(exp);
+      return lval && !lval->array_dims && lval->ident == ident;
+    };
+    Exp* rest = nullptr;
+    if (is_self(add->lhs.get())) {
+      rest = add->rhs.get();
+    } else if (is_self(add->rhs.get())) {
+      rest = add->lhs.get();
+    } else {
+      return false;
+    }
+    auto mul = dynamic_cast<MulExp*>(rest);
+    if (auto src = as_stream(rest)) {
+      helper = "__vec_sum";
+      srcs = {src};
+    } else if (mul && as_stream(mul->lhs.get()) &&
+               as_stream(mul->rhs.get())) {
+      helper = "__vec_dot";
+      srcs = {as_stream(mul->lhs.get()), as_stream(mul->rhs.get())};
+    } else {
+      return false;
+    }
+  }
+  std::cout << "genir vectorize loop on " << iv << " with " << helper
+            << std::endl;
+
+  auto emit = [&](const std::string& op, const std::string& lhs,
+                  const std::string& rhs) {
+    auto name = get_new_counter();
+    ir_code->append("  " + name + " = " + op + " " + lhs + ", " + rhs + "\n");
+    return name;
+  };
+  auto iv_var = std::get<std::string>(
+      sym_table_stack.get(iv, SymbolTables::SymbolKind::VAR));
+
+  // 2. trip count n
+  auto start_name = get_new_counter();
+  ir_code->append("  " + start_name + " = load " + iv_var + "\n");
+  info.bound_exp->accept(*this);
+  auto bound_name = pop_last_result();
+  auto trips = scev.gen_trip_count(info, start_name, bound_name, emit);
+
+  // 3. the helper call, i still holds start so the streams address their
+  // first element
+  std::vector<std::string> args;
+  std::vector<std::string> types;
+  if (dst) {
+    args.push_back(gen_elem_ptr(*dst));
+    types.push_back("*i32");
+  }
+  for (auto src : srcs) {
+    args.push_back(gen_elem_ptr(*src));
+    types.push_back("*i32");
+  }
+  std::string value_name;
+  if (value) {
+    value->accept(*this);
+    value_name = pop_last_result();
+    if (negate) {
+      value_name = emit("sub", "0", value_name);
+    }
+  }
+  // fill takes (dst, n, value), the others end with n
+  if (helper == "__vec_fill") {
+    args.push_back(trips);
+    types.push_back("i32");
+  }
+  if (value) {
+    args.push_back(value_name);
+    types.push_back("i32");
+  }
+  if (helper != "__vec_fill") {
+    args.push_back(trips);
+    types.push_back("i32");
+  }
+  std::string arg_list, type_list;
+  for (int k = 0; k < (int)args.size(); ++k) {
+    arg_list += (k ? ", " : "") + args[k];
+    type_list += (k ? ", " : "") + types[k];
+  }
+  bool reduction = dst == nullptr;
+  vector_helpers[helper] = "decl @" + helper + "(" + type_list + ")" +
+                           (reduction ? ": i32" : "") + "\n";
+  if (reduction) {
+    auto acc_var = std::get<std::string>(sym_table_stack.get(
+        assign->lval->ident, SymbolTables::SymbolKind::VAR));
+    auto result = get_new_counter();
+    ir_code->append("  " + result + " = call @" + helper + "(" + arg_list +
+                    ")\n");
+    auto acc = get_new_counter();
+    ir_code->append("  " + acc + " = load " + acc_var + "\n");
+    ir_code->append("  store " + emit("add", acc, result) + ", " + acc_var +
+                    "\n");
+  } else {
+    ir_code->append("  call @" + helper + "(" + arg_list + ")\n");
+  }
+  ir_code->append("  store " + emit("add", start_name, trips) + ", " + iv_var +
+                  "\n");
+  return true;
+}
+
+bool GenIRVisitor::gen_unswitched_loop(WhileStmt& node) {
+  auto body = dynamic_cast<BlockStmt*>(node.body.get());
+  if (unswitch_depth >= kUnswitchMaxDepth || body == nullptr) {
+    return false;
+  }
+  auto loop = LoopBodyVisitor();
+  node.cond->accept(loop);
+  node.body->accept(loop);
+  if (loop.cost > kUnswitchBudget) {
+    return false;
+  }
+  auto scev = ScalarEvolution(&sym_table_stack);
+  auto slot = &body->block_item;
+  IfStmt* branch = nullptr;
+  for (; *slot; slot = &(*slot)->next_block_item) {
+    branch = dynamic_cast<IfStmt*>(slot->get());
+    int value;
+    if (branch && !scev.eval_const(branch->cond.get(), value) &&
+        scev.is_invariant_cond(branch->cond.get(), loop)) {
+      break;
+    }
+  }
+  if (*slot == nullptr) {
+    return false;
+  }
+  std::cout << "genir unswitch loop on invariant condition" << std::endl;
+
+  /**
+   * the body with the if replaced by arm, as a list of block items:
+   * 1. no arm: nothing
+   * 2. a block without declarations: its items, inline, so that the loop
+   *    analyses see them as top-level statements
+   * 3. anything else: the arm itself
+   * the original list is restored after lowering
+   */
+  auto gen_version = [&](std::unique_ptr<Stmt>& arm) {
+    auto held = std::move(*slot);
+    auto rest = std::move(held->next_block_item);
+    auto block = dynamic_cast<BlockStmt*>(arm.get());
+    if (block) {
+      auto arm_body = LoopBodyVisitor();
+      arm_body.visit_list(block->block_item.get());
+      if (!arm_body.declared.empty()) {
+        block = nullptr;
+      }
+    }
+    enum { NONE, INLINE, ARM } mode;
+    BlockItem* tail = nullptr;
+    if (arm == nullptr || (block && block->block_item == nullptr)) {
+      mode = NONE;
+      *slot = std::move(rest);
+    } else if (block) {
+      mode = INLINE;
+      tail = block->block_item.get();
+      while (tail->next_block_item) {
+        tail = tail->next_block_item.get();
+      }
+      *slot = std::move(block->block_item);
+    } else {
+      mode = ARM;
+      tail = arm.get();
+      *slot = std::move(arm);
+    }
+    // the statements after an arm ending in break / continue / return are
+    // never reached in this version
+    bool jumps = dynamic_cast<BreakStmt*>(tail) ||
+                 dynamic_cast<ContinueStmt*>(tail) ||
+                 dynamic_cast<RetStmt*>(tail);
+    if (tail && !jumps) {
+      tail->next_block_item = std::move(rest);
+    }
+
+    unswitch_depth++;
+    visit(node);
+    unswitch_depth--;
+
+    if (tail && !jumps) {
+      rest = std::move(tail->next_block_item);
+    }
+    if (mode == NONE) {
+      rest = std::move(*slot);
+    } else if (mode == INLINE) {
+      block->block_item = std::move(*slot);
+    } else {
+      arm.reset(dynamic_cast<Stmt*>(slot->release()));
+    }
+    held->next_block_item = std::move(rest);
+    *slot = std::move(held);
+  };
+
+  auto suffix = std::to_string(block_label_counter);
+  block_label_counter++;
+  auto then_name = "%us_then_" + suffix;
+  auto else_name = "%us_else_" + suffix;
+  auto end_name = "%us_end_" + suffix;
+  gen_cond(branch->cond.get(), then_name, else_name);
+  ir_code->append(then_name + ":\n");
+  gen_version(branch->then_body);
+  ir_code->append("  jump " + end_name + "\n");
+  ir_code->append(else_name + ":\n");
+  gen_version(branch->else_body);
+  ir_code->append("  jump " + end_name + "\n");
+  ir_code->append(end_name + ":\n");
+  return true;
+}
+
+bool GenIRVisitor::gen_interchanged_loop(WhileStmt& node) {
+  auto scev = ScalarEvolution(&sym_table_stack);
+  auto outer = scev.analyze(node, preceding_items(node));
+  if (!outer.is_counted || outer.body.has_call || outer.items.size() != 3) {
+    return false;
+  }
+  auto init = dynamic_cast<AssignStmt*>(outer.items[0]);
+  auto loop = dynamic_cast<WhileStmt*>(outer.items[1]);
+  if (init == nullptr || loop == nullptr || init->lval->array_dims) {
+    return false;
+  }
+  auto inner = scev.analyze(*loop, {init});
+  auto& i = outer.iv.ident;
+  auto& j = inner.iv.ident;
+  if (!inner.is_counted || inner.body.has_loop || j != init->lval->ident ||
+      inner.body.declared.count(i) || inner.body.declared.count(j) ||
+      !scev.is_invariant(init->exp.get(), outer.body) ||
+      !scev.is_invariant(inner.bound_exp, outer.body)) {
+    return false;
+  }
+
+  // 1. other scalars written by the inner body: its own temporaries, or
+  // sums `x = x + e` / `x = x - e` not read anywhere else
+  auto is_sum = [&](const std::string& ident) {
+    if (inner.body.assigned.at(ident) != 1 ||
+        inner.body.scalar_reads[ident] != 1) {
+      return false;
+    }
+    for (auto item : inner.items) {
+      auto assign = dynamic_cast<AssignStmt*>(item);
+      if (assign && !assign->lval->array_dims &&
+          assign->lval->ident == ident) {
+        auto binary = dynamic_cast<BinaryExp*>(assign->exp.get());
+        auto is_self = [&](Exp* exp) {
+          auto lval = dynamic_cast<LValExp*>(exp);
+          return lval && !lval->array_dims && lval->ident == ident;
+        };
+        if (dynamic_cast<AddExp*>(binary)) {
+          return is_self(binary->lhs.get()) || is_self(binary->rhs.get());
+        }
+        return dynamic_cast<SubExp*>(binary) && is_self(binary->lhs.get());
+      }
+    }
+    return false;
+  };
+  for (auto& [ident, count] : inner.body.assigned) {
+    bool temporary = inner.body.declared.count(ident) &&
+                     !sym_table_stack.find(ident, SymbolTables::SymbolKind::VAR);
+    if (ident != j && !temporary && !is_sum(ident)) {
+      return false;
+    }
+  }
+
+  // 2. dependences: a written array is only accessed at the element
+  // written, so two iterations touching it are the same iteration, or
+  // differ in one loop only
+  std::vector<LValExp*> accesses = inner.body.array_reads;
+  for (auto store : inner.body.array_stores) {
+    accesses.push_back(store->lval.get());
+  }
+  auto is_global_array = [&](const std::string& ident) {
+    return sym_table_stack.find(ident) == SymbolTables::SymbolKind::VAR_ARR &&
+           sym_table_stack.find_layer_num(
+               ident, SymbolTables::SymbolKind::VAR_ARR) == 1;
+  };
+  for (auto store : inner.body.array_stores) {
+    auto lval = store->lval.get();
+    auto kind = sym_table_stack.find(lval->ident);
+    if (kind == SymbolTables::SymbolKind::VAR_ARR &&
+        !sym_table_stack.get_var_arr_info(lval->ident).scalars.empty()) {
+      return false;
+    }
+    bool moves = false;
+    for (auto dim = lval->array_dims.get(); dim; dim = dim->next_dim.get()) {
+      int offset;
+      if (scev.match_iv_offset(dim->exp.get(), i, offset) ||
+          scev.match_iv_offset(dim->exp.get(), j, offset)) {
+        moves = true;
+      } else if (!scev.is_invariant(dim->exp.get(), outer.body)) {
+        return false;
+      }
+    }
+    if (!moves) {
+      return false;
+    }
+    for (auto access : accesses) {
+      if (access->ident == lval->ident) {
+        if (!same_exp(access, lval)) {
+          return false;
+        }
+        continue;
+      }
+      // a pointer may point into any global array or another pointer's
+      auto other = sym_table_stack.find(access->ident);
+      bool may_alias =
+          kind == SymbolTables::SymbolKind::PTR
+              ? other == SymbolTables::SymbolKind::PTR ||
+                    is_global_array(access->ident)
+              : is_global_array(lval->ident) &&
+                    other == SymbolTables::SymbolKind::PTR;
+      if (may_alias) {
+        return false;
+      }
+    }
+  }
+
+  // 3. worth it if fewer accesses stride over rows with i innermost
+  auto strided = [&](const std::string& iv) {
+    int count = 0;
+    for (auto access : accesses) {
+      bool in_leading = false, in_last = false;
+      for (auto dim = access->array_dims.get(); dim;
+           dim = dim->next_dim.get()) {
+        if (mentions(dim->exp.get(), iv)) {
+          (dim->next_dim ? in_leading : in_last) = true;
+        }
+      }
+      count += in_leading && !in_last;
+    }
+    return count;
+  };
+  if (strided(i) >= strided(j)) {
+    return false;
+  }
+  // a loop of the nest that is worth tiling and simple to tile
+  auto tiles = [&](const LoopInfo& info) {
+    return info.op == "lt" && info.iv.step == 1 &&
+           (!info.const_trip_count || info.trip_count >= kTileMinTrips);
+  };
+  bool tiled = tiles(outer) && tiles(inner);
+  std::cout << "genir interchange loops on " << i << " and " << j
+            << (tiled ? " (tiled)" : "") << std::endl;
+
+  auto suffix = std::to_string(block_label_counter);
+  block_label_counter++;
+  auto check_name = "%ic_check_" + suffix;
+  auto skip_name = "%ic_skip_" + suffix;
+  auto swap_name = "%ic_swap_" + suffix;
+  auto end_name = "%ic_end_" + suffix;
+  auto i_name = std::get<std::string>(
+      sym_table_stack.get(i, SymbolTables::SymbolKind::VAR));
+  auto j_name = std::get<std::string>(
+      sym_table_stack.get(j, SymbolTables::SymbolKind::VAR));
+
+  // 4. the swapped nest needs both loops to run at least once. j = j0 is
+  // what the first trip of the original nest starts with anyway, and if
+  // the inner loop doesn't run then, it doesn't run on any trip, so all
+  // that is left of the nest is stepping i
+  gen_cond(node.cond.get(), check_name, end_name);
+  ir_code->append(check_name + ":\n");
+  init->accept(*this);
+  gen_cond(loop->cond.get(), swap_name, skip_name);
+  ir_code->append(skip_name + ":\n");
+  outer.iv_update->accept(*this);
+  gen_cond(node.cond.get(), skip_name, end_name);
+
+  // 5. the variables of the swapped nest, i restarts from its value at
+  // entry for every j. with tiles that is the start of the current i tile,
+  // and the bounds of i and j are the ends of the current tiles.
+  // ic.<name>.<n> is not a valid SysY identifier, so it can't clash with one
+  ir_code->append(swap_name + ":\n");
+  sym_table_stack.push_table();
+  auto add_var = [&](const std::string& name) {
+    auto sym_name = "%ic_" + name + "_" + suffix;
+    ir_code->append("  " + sym_name + " = alloc i32\n");
+    sym_table_stack.insert_to_top("ic." + name + "." + suffix, sym_name,
+                                  SymbolTables::SymbolKind::VAR);
+    return sym_name;
+  };
+  auto load = [&](const std::string& sym_name) {
+    auto value = get_new_counter();
+    ir_code->append("  " + value + " = load " + sym_name + "\n");
+    return value;
+  };
+  auto start_name = add_var("start");
+  ir_code->append("  store " + load(i_name) + ", " + start_name + "\n");
+  auto lval_of = [&](const std::string& ident) {
+    auto lval = std::make_unique<LValExp>();
+    lval->ident = ident;
+    return lval;
+  };
+  auto lt_tile_end = [&](const std::string& ident, const std::string& end) {
+    auto cond = std::make_unique<LTExp>();
+    cond->lhs = lval_of(ident);
+    cond->rhs = lval_of("ic." + end + "." + suffix);
+    return cond;
+  };
+  std::string i_tile_name, j_tile_name, i_bound_name, j_bound_name;
+  std::string i_end_name, j_end_name;
+  auto i_tile_label = "%ic_i_tile_" + suffix;
+  auto j_tile_label = "%ic_j_tile_" + suffix;
+  auto j_next_label = "%ic_j_next_" + suffix;
+  // end of the tile starting at the value of from: min(bound, from + T),
+  // also if from + T wraps around
+  auto gen_tile_end = [&](const std::string& from, const std::string& bound,
+                          const std::string& to) {
+    auto start = load(from), limit = load(bound);
+    auto end = get_new_counter();
+    ir_code->append("  " + end + " = add " + start + ", " +
+                    std::to_string(kTileSize) + "\n");
+    auto past = get_new_counter(), wraps = get_new_counter();
+    auto clamp = get_new_counter();
+    ir_code->append("  " + past + " = gt " + end + ", " + limit + "\n");
+    ir_code->append("  " + wraps + " = lt " + end + ", " + start + "\n");
+    ir_code->append("  " + clamp + " = or " + past + ", " + wraps + "\n");
+    auto diff = get_new_counter(), mul = get_new_counter();
+    auto result = get_new_counter();
+    ir_code->append("  " + diff + " = sub " + limit + ", " + end + "\n");
+    ir_code->append("  " + mul + " = mul " + clamp + ", " + diff + "\n");
+    ir_code->append("  " + result + " = add " + end + ", " + mul + "\n");
+    ir_code->append("  store " + result + ", " + to + "\n");
+  };
+  // the tile loops step from tile end to tile end until the bound:
+  // from = end; br from < bound, head, exit
+  auto gen_tile_latch = [&](const std::string& from, const std::string& end,
+                            const std::string& bound, const std::string& head,
+                            const std::string& exit) {
+    auto value = load(end);
+    ir_code->append("  store " + value + ", " + from + "\n");
+    auto more = get_new_counter();
+    ir_code->append("  " + more + " = lt " + value + ", " + load(bound) +
+                    "\n");
+    ir_code->append("  br " + more + ", " + head + ", " + exit + "\n");
+  };
+  if (tiled) {
+    // both bounds are invariant, evaluated once
+    i_bound_name = add_var("i_bound");
+    outer.bound_exp->accept(*this);
+    ir_code->append("  store " + pop_last_result() + ", " + i_bound_name +
+                    "\n");
+    j_bound_name = add_var("j_bound");
+    inner.bound_exp->accept(*this);
+    ir_code->append("  store " + pop_last_result() + ", " + j_bound_name +
+                    "\n");
+    i_tile_name = add_var("i_tile");
+    j_tile_name = add_var("j_tile");
+    i_end_name = add_var("i_end");
+    j_end_name = add_var("j_end");
+    ir_code->append("  store " + load(j_name) + ", " + j_tile_name + "\n");
+    ir_code->append("  jump " + j_tile_label + "\n");
+    ir_code->append(j_tile_label + ":\n");
+    gen_tile_end(j_tile_name, j_bound_name, j_end_name);
+    ir_code->append("  store " + load(start_name) + ", " + i_tile_name +
+                    "\n");
+    ir_code->append("  jump " + i_tile_label + "\n");
+    ir_code->append(i_tile_label + ":\n");
+    gen_tile_end(i_tile_name, i_bound_name, i_end_name);
+    ir_code->append("  store " + load(j_tile_name) + ", " + j_name + "\n");
+  }
+
+  // 6. the swapped nest is built from the statements of the original one,
+  // which are moved back afterwards, and lowered like any other loop nest:
+  // while (j ..) { i = start; while (i ..) { s; i = ..; } j = ..; }
+  auto inner_body = static_cast<BlockStmt*>(loop->body.get());
+  auto find_slot = [](std::unique_ptr<BlockItem>& head, BlockItem* item) {
+    auto slot = &head;
+    while (slot->get() != item) {
+      slot = &(*slot)->next_block_item;
+    }
+    return slot;
+  };
+  auto restart = std::make_unique<AssignStmt>();
+  restart->lval = lval_of(i);
+  restart->exp = lval_of("ic." + std::string(tiled ? "i_tile" : "start") +
+                         "." + suffix);
+  auto swapped_inner = std::make_unique<WhileStmt>();
+  swapped_inner->cond =
+      tiled ? lt_tile_end(i, "i_end") : std::move(node.cond);
+  auto swapped_inner_body = std::make_unique<BlockStmt>();
+  swapped_inner_body->block_item = std::move(inner_body->block_item);
+  auto slot = find_slot(swapped_inner_body->block_item, inner.iv_update);
+  swapped_inner->next_block_item = std::move(*slot);
+  *slot = std::move(loop->next_block_item);
+  swapped_inner->body = std::move(swapped_inner_body);
+  restart->next_block_item = std::move(swapped_inner);
+  auto swapped_body = std::make_unique<BlockStmt>();
+  swapped_body->block_item = std::move(restart);
+  WhileStmt swapped;
+  swapped.cond = tiled ? lt_tile_end(j, "j_end") : std::move(loop->cond);
+  swapped.body = std::move(swapped_body);
+
+  visit(swapped);
+
+  auto swapped_inner_ptr = static_cast<WhileStmt*>(
+      static_cast<BlockStmt*>(swapped.body.get())
+          ->block_item->next_block_item.get());
+  if (!tiled) {
+    loop->cond = std::move(swapped.cond);
+    node.cond = std::move(swapped_inner_ptr->cond);
+  }
+  auto swapped_inner_block =
+      static_cast<BlockStmt*>(swapped_inner_ptr->body.get());
+  slot = find_slot(swapped_inner_block->block_item, outer.iv_update);
+  loop->next_block_item = std::move(*slot);
+  *slot = std::move(swapped_inner_ptr->next_block_item);
+  inner_body->block_item = std::move(swapped_inner_block->block_item);
+  sym_table_stack.pop_table();
+
+  // 7. the next i tile, then the next j tile
+  if (tiled) {
+    gen_tile_latch(i_tile_name, i_end_name, i_bound_name, i_tile_label,
+                   j_next_label);
+    ir_code->append(j_next_label + ":\n");
+    gen_tile_latch(j_tile_name, j_end_name, j_bound_name, j_tile_label,
+                   end_name);
+  } else {
+    ir_code->append("  jump " + end_name + "\n");
+  }
+
+  ir_code->append(end_name + ":\n");
+  return true;
+}
+
+bool GenIRVisitor::gen_carried_loop(WhileStmt& node) {
+  auto scev = ScalarEvolution(&sym_table_stack);
+  auto info = scev.analyze(node, preceding_items(node));
+  if (!info.is_counted || info.body.has_call ||
+      info.body.array_stores.size() != 1) {
+    return false;
+  }
+  auto store = info.body.array_stores[0];
+  auto& ident = store->lval->ident;
+  auto& iv = info.iv.ident;
+  int store_index =
+      std::find(info.items.begin(), info.items.end(), store) -
+      info.items.begin();
+  if (store_index == (int)info.items.size() || info.body.declared.count(ident) ||
+      info.body.declared.count(iv)) {
+    return false;
+  }
+
+  // 1. the store: a[..][i + c0] with invariant leading indices
+  auto kind = sym_table_stack.find(ident);
+  int array_dim;
+  if (kind == SymbolTables::SymbolKind::VAR_ARR) {
+    auto arr_info = sym_table_stack.get_var_arr_info(ident);
+    if (!arr_info.scalars.empty()) {
+      return false;
+    }
+    array_dim = arr_info.dims.size();
+  } else if (kind == SymbolTables::SymbolKind::PTR) {
+    array_dim = sym_table_stack.get_ptr_info(ident).dims;
+  } else {
+    return false;
+  }
+  int refer_dim = 0;
+  auto dim = store->lval->array_dims.get();
+  for (; dim->next_dim; dim = dim->next_dim.get()) {
+    if (!scev.is_invariant(dim->exp.get(), info.body)) {
+      return false;
+    }
+    refer_dim += 1;
+  }
+  int store_offset;
+  if (refer_dim + 1 != array_dim ||
+      !scev.match_iv_offset(dim->exp.get(), iv, store_offset)) {
+    return false;
+  }
+  long long offset = (long long)store_offset - info.iv.step;
+  if (offset < INT32_MIN || offset > INT32_MAX) {
+    return false;
+  }
+  CarriedRef ref = {store, iv, (int)offset, ""};
+
+  // 2. the carried element is read, and only before it is overwritten, i.e.
+  // up to the store. a read after it would need the value of this iteration
+  LoopBodyVisitor before, after;
+  for (int k = 0; k < (int)info.items.size(); ++k) {
+    info.items[k]->accept(k <= store_index ? before : after);
+  }
+  for (auto read : after.array_reads) {
+    if (read->ident == ident) {
+      return false;
+    }
+  }
+  LValExp* read = nullptr;
+  carried_refs.push_back(ref);
+  for (auto candidate : before.array_reads) {
+    if (find_carried_ref(*candidate) == &carried_refs.back()) {
+      read = candidate;
+      break;
+    }
+  }
+  carried_refs.pop_back();
+  if (read == nullptr) {
+    return false;
+  }
+  std::cout << "genir carry " << ident << " across iterations of loop on "
+            << iv << std::endl;
+
+  // 3. the element the first iteration reads, if the loop runs at all
+  auto suffix = std::to_string(block_label_counter);
+  block_label_counter++;
+  auto carry_init_name = "%carry_init_" + suffix;
+  auto carry_loop_name = "%carry_loop_" + suffix;
+  ref.carry_name = "%carried_" + suffix;
+  ir_code->append("  " + ref.carry_name + " = alloc i32\n");
+  gen_cond(node.cond.get(), carry_init_name, carry_loop_name);
+  ir_code->append(carry_init_name + ":\n");
+  read->accept(*this);
+  auto init_name = pop_last_result();
+  ir_code->append("  store " + init_name + ", " + ref.carry_name + "\n");
+  ir_code->append("  jump " + carry_loop_name + "\n");
+  ir_code->append(carry_loop_name + ":\n");
+
+  // 4. the loop itself
+  carried_refs.push_back(ref);
+  if (!gen_unrolled_loop(node)) {
+    gen_rotated_loop(node);
+  }
+  carried_refs.pop_back();
+  return true;
+}
+
+const GenIRVisitor::CarriedRef* GenIRVisitor::find_carried_ref(
+    LValExp& node) {
+  auto scev = ScalarEvolution(&sym_table_stack);
+  for (auto it = carried_refs.rbegin(); it != carried_refs.rend(); ++it) {
+    auto lval = it->store->lval.get();
+    if (node.ident != lval->ident) {
+      continue;
+    }
+    auto dim = node.array_dims.get();
+    auto store_dim = lval->array_dims.get();
+    while (dim && store_dim && dim->next_dim && store_dim->next_dim &&
+           same_exp(dim->exp.get(), store_dim->exp.get())) {
+      dim = dim->next_dim.get();
+      store_dim = store_dim->next_dim.get();
+    }
+    int offset;
+    if (dim && store_dim && !dim->next_dim && !store_dim->next_dim &&
+        scev.match_iv_offset(dim->exp.get(), it->iv, offset) &&
+        offset == it->offset) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
+bool GenIRVisitor::gen_promoted_loop(WhileStmt& node) {
+  auto loop = LoopBodyVisitor();
+  node.cond->accept(loop);
+  node.body->accept(loop);
+  if (loop.has_call || loop.has_return) {
+    return false;
+  }
+  // globals written in the loop, not yet promoted by an enclosing loop
+  std::vector<std::string> globals;
+  for (auto& [ident, count] : loop.assigned) {
+    if (!loop.declared.count(ident) &&
+        sym_table_stack.find(ident) == SymbolTables::SymbolKind::VAR &&
+        sym_table_stack.find_layer_num(ident, SymbolTables::SymbolKind::VAR) ==
+            1) {
+      globals.push_back(ident);
+    }
+  }
+  if (globals.empty()) {
+    return false;
+  }
+  std::sort(globals.begin(), globals.end());
+
+  sym_table_stack.push_table();
+  std::vector<std::pair<std::string, std::string>> copies;
+  for (auto& ident : globals) {
+    auto global_name = std::get<std::string>(
+        sym_table_stack.get(ident, SymbolTables::SymbolKind::VAR));
+    int count =
+        sym_table_stack.total_accurrences(ident, SymbolTables::SymbolKind::VAR);
+    auto local_name = "@" + ident + "_" + std::to_string(count + 1);
+    std::cout << "genir promote global " << global_name << " to "
+              << local_name << std::endl;
+    sym_table_stack.insert_to_top(ident, local_name,
+                                  SymbolTables::SymbolKind::VAR);
+    sym_table_stack.promoted_globals.insert(local_name);
+    copies.push_back({global_name, local_name});
+
+    auto value = get_new_counter();
+    ir_code->append("  " + local_name + " = alloc i32\n");
+    ir_code->append("  " + value + " = load " + global_name + "\n");
+    ir_code->append("  store " + value + ", " + local_name + "\n");
+  }
+  visit(node);
+  for (auto& [global_name, local_name] : copies) {
+    auto value = get_new_counter();
+    ir_code->append("  " + value + " = load " + local_name + "\n");
+    ir_code->append("  store " + value + ", " + global_name + "\n");
+  }
+  sym_table_stack.pop_table();
+  return true;
+}
+
 void GenIRVisitor::visit(WhileStmt& node) {
   std::cout << "genir visit whilestmt" << std::endl;
-  auto while_entry_name = "%while_entry_" + std::to_string(block_label_counter);
+  if (gen_unswitched_loop(node)) {
+    return;
+  }
+  if (vectorize && gen_vectorized_loop(node)) {
+    return;
+  }
+  // promotion only pays off if the loop stays a loop
+  if (gen_closed_form(node) || gen_promoted_loop(node) ||
+      gen_interchanged_loop(node) || gen_carried_loop(node) ||
+      gen_unrolled_loop(node)) {
+    return;
+  }
+  gen_rotated_loop(node);
+}
+
+void GenIRVisitor::gen_rotated_loop(WhileStmt& node) {
+  /**
+   * rotated loop (guarded do-while):
+   *   cond -> body / end          // guard, in the preheader
+   * %while_body:
+   *   body
+   * %while_latch:                 // continue target
+   *   cond -> body / end          // the only branch of the steady state
+   * %while_end:
+   */
   auto while_body_name = "%while_body_" + std::to_string(block_label_counter);
+  auto while_latch_name =
+      "%while_latch_" + std::to_string(block_label_counter);
   auto while_end_name = "%while_end_" + std::to_string(block_label_counter);
-  while_stack.push_while_label(while_entry_name, while_end_name);
+  while_stack.push_while_label(while_latch_name, while_end_name);
   block_label_counter++;
-  ir_code->append("  jump " + while_entry_name + "\n");
-  ir_code->append(while_entry_name + ":\n");
-  node.cond->accept(*this);
-  auto cond_name = pop_last_result();
-  ir_code->append("  br " + cond_name + ", " + while_body_name + ", " +
-                  while_end_name + "\n");
+  gen_cond(node.cond.get(), while_body_name, while_end_name);
   ir_code->append(while_body_name + ":\n");
   node.body->accept(*this);
   // TODO: this way is pretty hacky
   if (get_last_ir_line(ir_code).substr(2, 3) != "ret" &&
       get_last_ir_line(ir_code).substr(2, 4) != "jump" &&
       get_last_ir_line(ir_code).substr(2, 2) != "br") {
-    ir_code->append("  jump " + while_entry_name + "\n");
+    ir_code->append("  jump " + while_latch_name + "\n");
   }
+  ir_code->append(while_latch_name + ":\n");
+  gen_cond(node.cond.get(), while_body_name, while_end_name);
   ir_code->append(while_end_name + ":\n");
   while_stack.pop_while_label();
 }
@@ -789,6 +2143,15 @@ void GenIRVisitor::visit(ContinueStmt& node) {
 
 void GenIRVisitor::visit(LValExp& node) {
   // auto find_it = sym_table.find(node.ident);
+  if (!carried_refs.empty()) {
+    if (auto ref = find_carried_ref(node)) {
+      auto result_name = get_new_counter();
+      ir_code->append("  " + result_name + " = load " + ref->carry_name +
+                      "\n");
+      push_result(result_name);
+      return;
+    }
+  }
 
   auto kind = sym_table_stack.find(node.ident);
   switch (kind) {
@@ -853,6 +2216,11 @@ void GenIRVisitor::visit(LValExp& node) {
        * %2 = load %1
        */
       std::cout << "gen lval var arr: " << node.ident << "\n";
+      auto arr_info = sym_table_stack.get_var_arr_info(node.ident);
+      if (!arr_info.scalars.empty()) {
+        gen_scalar_elem_load(node, arr_info);
+        break;
+      }
       auto arr_sym_name = std::get<std::string>(
           sym_table_stack.get(node.ident, SymbolTables::SymbolKind::VAR_ARR));
       auto index_ptr = node.array_dims.get();
@@ -1023,6 +2391,10 @@ void GenIRVisitor::visit(VarDef& node) {
       ir_code->append("\n");
     } else {
       std::cout << "gen local var array\n";
+      if (gen_scalar_replaced_array(node, link_list_visitor.result,
+                                    array_evaluator.result)) {
+        return;
+      }
       ir_code->append("  " + sym_name + " = alloc ");
       push_result(sym_name);
       node.array_dims->accept(*this);  // generate array type like [[i32, 3], 2]
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <map>
 #include <memory>
 #include <stack>
 #include <unordered_map>
 #include <variant>
 
 #include "prune.hpp"
+#include "select.hpp"
+#include "scev.hpp"
+#include "simplify.hpp"
+#include "sra.hpp"
 #include "symtable.hpp"
 #include "visitor.hpp"
 #include "whilestack.hpp"
@@ -21,6 +26,14 @@ class GenIRVisitor : public Visitor {
 
   WhileStack while_stack;
 
+  // block items visited so far in each enclosing block, innermost last
+  std::vector<std::vector<BlockItem*>> block_items;
+
+  // -march=rv32imv: lower vectorizable loops to the RVV helpers
+  bool vectorize = false;
+  // helpers called so far, name -> declaration
+  std::map<std::string, std::string> vector_helpers;
+
  private:
   int tempCounter = 0;
   std::stack<std::string> tempCounterSt;
@@ -49,6 +62,14 @@ class GenIRVisitor : public Visitor {
     return tempCounterSt.top();
   }
 
+  /**
+   * both operands are constants (e.g. const symbols, which the ast
+   * simplifier can't see through): push the folded value instead of
+   * emitting the instruction
+   */
+  bool fold_binary(const std::string& op, const std::string& lhs,
+                   const std::string& rhs);
+
   // used to add label after ret
   // int ret_label_counter = 0;
   // used to add label before each basic block
@@ -122,6 +143,188 @@ class GenIRVisitor : public Visitor {
 
   void gen_array_indices(std::vector<std::string>& indices,
                          std::string& arr_sym_name);
+
+  // address of a fully indexed array element (var array or ptr)
+  std::string gen_elem_ptr(LValExp& lval);
+
+  /**
+   * scalar replacement of aggregates
+   * a small local array whose later uses are all element accesses with
+   * indices known at compile time (see ArrayUseVisitor) gets one i32 alloc
+   * per element instead of an array alloc, so no getelemptr is left and
+   * every element is a plain variable to the backend. returns false (and
+   * emits nothing) if the array doesn't qualify
+   */
+  bool gen_scalar_replaced_array(
+      VarDef& node, const std::vector<int>& shape,
+      const std::vector<std::variant<Exp*, int>>& data);
+  static constexpr int kScalarReplaceMaxElems = 16;
+
+  /**
+   * row-major index of an element of a scalar-replaced array, a constant
+   * if all indices are (is_const), otherwise a value computed at runtime
+   */
+  std::string gen_flat_index(LValExp& lval, const std::vector<int>& dims,
+                             bool& is_const);
+
+  // element access of a scalar-replaced array, a runtime index picks the
+  // element with a compare chain over all of them
+  void gen_scalar_elem_load(LValExp& lval,
+                            const SymbolTables::VarArrInfo& info);
+  void gen_scalar_elem_store(LValExp& lval,
+                             const SymbolTables::VarArrInfo& info, Exp* exp);
+
+  /**
+   * condition-context lowering (jumping code)
+   * emit code that branches to true_label if exp is non-zero and to
+   * false_label otherwise, without materializing the boolean value.
+   * && / || / ! are turned into control flow directly.
+   */
+  void gen_cond(Exp* exp, const std::string& true_label,
+                const std::string& false_label);
+
+  // && / || used as data, lowered with gen_cond and joined into a 0/1 value
+  void gen_logical_value(Exp* exp);
+
+  /**
+   * if-conversion
+   * `if (c) x = a; else x = b;` (or without else, where b is x itself) with
+   * side-effect-free arms is emitted as a branchless select:
+   * x = b + ((a - b) & -c)
+   * returns false (and emits nothing) if the diamond doesn't qualify
+   */
+  bool gen_select(IfStmt& node);
+  // max number of expression nodes evaluated speculatively in both arms
+  static constexpr int kSelectBudget = 8;
+
+  // visit a list of block items (in the current scope), recording them in
+  // block_items so that later items can look at their predecessors
+  void visit_block_items(BlockItem* item, BlockItem* stop = nullptr);
+
+  // the items before node in its block, empty if node is not a block item
+  // of the innermost block (e.g. the body of an if)
+  std::vector<BlockItem*> preceding_items(Stmt& node);
+
+  // the default while lowering, see visit(WhileStmt&)
+  void gen_rotated_loop(WhileStmt& node);
+
+  /**
+   * loop unrolling for innermost counted loops (see LoopInfo)
+   * 1. known start and constant trip count within budget: fully unrolled,
+   *    with i bound to a constant in every copy
+   * 2. otherwise: the body is repeated kUnrollFactor times in a loop that
+   *    runs while kUnrollFactor iterations remain, followed by the original
+   *    loop as remainder
+   * returns false (and emits nothing) if the loop doesn't qualify
+   */
+  bool gen_unrolled_loop(WhileStmt& node);
+
+  /**
+   * final value replacement
+   * a counted loop whose body only updates add-recurrences (see LoopInfo)
+   * is replaced by the closed form of every recurrence, computed from the
+   * symbolic trip count t:
+   * 1. x = x + e:        x + t * e
+   * 2. x = x + r:        x + t * r0 + e_r * (t * (t - 1) / 2 + b * t)
+   *    (r = r + e_r, b = 1 if r is updated before x)
+   * all arithmetic wraps like the loop itself would. t * (t - 1) / 2 halves
+   * the even factor first so the division stays exact.
+   * returns false (and emits nothing) if the loop doesn't qualify
+   */
+  bool gen_closed_form(WhileStmt& node);
+  /**
+   * scalar promotion of globals
+   * every access to a global goes through its address, so a loop without
+   * calls or returns that updates a global scalar gets a local copy of it:
+   * loaded once before the loop, stored back once after it. breaks leave
+   * through the end of the loop too, and a global scalar can only be
+   * accessed by name, so nothing else in the loop sees a stale value.
+   * returns false (and emits nothing) if there is nothing to promote
+   */
+  bool gen_promoted_loop(WhileStmt& node);
+
+  /**
+   * loop vectorization (idiom recognition)
+   * an innermost counted loop `while (i < n) { s; i = i + 1; }` whose single
+   * statement s works on unit-stride elements a[..][i] is replaced by a call
+   * to an RVV helper (see backend/vector.hpp) over all its trips:
+   * 1. a[i] = e                    __vec_fill
+   * 2. a[i] = b[i]                 __vec_copy
+   * 3. a[i] = b[i] op c[i]         __vec_add / __vec_sub / __vec_mul
+   * 4. a[i] = b[i] op e            __vec_addx / __vec_mulx (b[i] - e too)
+   * 5. x = x + a[i]                __vec_sum
+   * 6. x = x + a[i] * b[i]         __vec_dot
+   * e is loop invariant. a stored array must not overlap the arrays read,
+   * so those must be distinct local / global arrays, or the very same
+   * element. returns false (and emits nothing) if the loop doesn't qualify
+   */
+  bool gen_vectorized_loop(WhileStmt& node);
+
+  /**
+   * loop unswitching
+   * a top-level `if (c)` of a loop body whose condition is loop invariant
+   * is decided once before the loop, which is then lowered twice, with the
+   * if replaced by its then arm and by its else arm (or nothing). each
+   * version goes through visit(WhileStmt&) again, so it can be unswitched
+   * further, unrolled or vectorized. only bodies within kUnswitchBudget
+   * AST nodes, and at most kUnswitchMaxDepth conditions per loop.
+   * returns false (and emits nothing) if the loop doesn't qualify
+   */
+  bool gen_unswitched_loop(WhileStmt& node);
+  static constexpr int kUnswitchBudget = 64;
+  static constexpr int kUnswitchMaxDepth = 2;
+  int unswitch_depth = 0;
+
+  /**
+   * loop interchange
+   * a nest `while (i ..) { j = j0; while (j ..) { s; j = j + c; } i = ..; }`
+   * of counted loops whose inner body walks arrays along the leading
+   * dimension (a[j][i]) is lowered with the loops swapped, so that the
+   * inner loop moves along rows. legal if every array the body writes is
+   * only accessed at the very element written, indexed by invariants and
+   * i + c / j + c, and every other scalar it writes is a sum (wrapping adds
+   * commute). the swapped nest needs both loops to run at least once, so
+   * the original nest stays as the other version.
+   * the swapped nest is also tiled if both loops count up by 1 with `<` and
+   * neither is known to run fewer than kTileMinTrips times: two loops over
+   * tiles of kTileSize iterations go around it, and the loops of the nest
+   * only run from the start of a tile to min(bound, start + kTileSize).
+   * the same test makes this legal, iterations touching the same element
+   * differ in one loop only and keep their order within it.
+   * returns false (and emits nothing) if the nest doesn't qualify
+   */
+  bool gen_interchanged_loop(WhileStmt& node);
+  static constexpr int kTileSize = 32;
+  static constexpr int kTileMinTrips = 64;
+
+  /**
+   * scalar replacement of loop-carried array references
+   * in a counted loop (see LoopInfo) whose only array store is a top-level
+   * `a[..][i + c0] = e`, a read of a[..][i + c1] with c0 - c1 == step sees
+   * the value the previous iteration stored, like dp[i - 1] in
+   * `dp[i] = dp[i - 1] + x`. that value is carried in a local instead:
+   * loaded once before the loop, set by the store, and read in place of
+   * the element. the store itself stays, then the loop is lowered as usual.
+   * returns false (and emits nothing) if the loop doesn't qualify
+   */
+  bool gen_carried_loop(WhileStmt& node);
+  struct CarriedRef {
+    AssignStmt* store;
+    std::string iv;
+    int offset;  // c1
+    std::string carry_name;
+  };
+  // carried references of the loops being lowered, innermost last
+  std::vector<CarriedRef> carried_refs;
+  // the carry of node, if it reads a carried element
+  const CarriedRef* find_carried_ref(LValExp& node);
+  // below this many known trips the call costs more than it saves
+  static constexpr int kVectorMinTrips = 8;
+
+  static constexpr int kFullUnrollMaxTrips = 16;
+  static constexpr int kUnrollFactor = 4;
+  // max AST nodes of the unrolled body copies
+  static constexpr int kUnrollBudget = 160;
 };
 
 }  // namespace AST
\ No newline at end of file
@@ -0,0 +1,625 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ast.hpp"
+#include "eval.hpp"
+#include "symtable.hpp"
+#include "visitor.hpp"
+
+namespace AST {
+
+/**
+ * summary of a loop body (or any statement list)
+ * 1. cost: number of AST nodes, a rough code size estimate
+ * 2. assigned: scalar variables written by an assignment, with the number
+ *    of assignments
+ * 3. declared: names declared anywhere inside
+ * 4. has_jump: a return, or a break / continue of the loop itself
+ *    (break / continue of an inner loop are fine)
+ * 5. has_return: a return
+ * 6. has_call: any function call
+ * 7. has_loop: an inner while loop
+ * 8. array_stores: assignments to array elements
+ * 9. array_reads: reads of an array element or row (also through pointers)
+ * 10. scalar_reads: names read without indices, with the number of reads
+ */
+class LoopBodyVisitor : public Visitor {
+ public:
+  int cost = 0;
+  std::unordered_map<std::string, int> assigned;
+  std::unordered_set<std::string> declared;
+  bool has_jump = false;
+  bool has_return = false;
+  bool has_call = false;
+  bool has_loop = false;
+  std::vector<AssignStmt*> array_stores;
+  std::vector<LValExp*> array_reads;
+  std::unordered_map<std::string, int> scalar_reads;
+
+  void visit(ConstDecl& node) override {
+    auto def = node.const_def.get();
+    while (def) {
+      declared.insert(def->ident);
+      def = def->next_const_def.get();
+    }
+  }
+  void visit(VarDecl& node) override {
+    auto def = node.var_def.get();
+    while (def) {
+      cost += 1;
+      declared.insert(def->ident);
+      if (def->var_init_val) {
+        def->var_init_val->accept(*this);
+      }
+      def = def->next_var_def.get();
+    }
+  }
+  void visit(ArrayInitVal& node) override {
+    if (node.exp) {
+      node.exp->accept(*this);
+    }
+    for (auto& sub : node.array_init_val_hierarchy) {
+      sub->accept(*this);
+    }
+  }
+
+  void visit(RetStmt& node) override {
+    has_jump = true;
+    has_return = true;
+  }
+  void visit(AssignStmt& node) override {
+    cost += 1;
+    if (node.lval->array_dims == nullptr) {
+      assigned[node.lval->ident] += 1;
+    } else {
+      array_stores.push_back(&node);
+    }
+    visit_lval(*node.lval);
+    node.exp->accept(*this);
+  }
+  void visit(ExpStmt& node) override {
+    if (node.exp) {
+      node.exp->accept(*this);
+    }
+  }
+  void visit(BlockStmt& node) override { visit_list(node.block_item.get()); }
+  void visit(IfStmt& node) override {
+    cost += 1;
+    node.cond->accept(*this);
+    node.then_body->accept(*this);
+    if (node.else_body) {
+      node.else_body->accept(*this);
+    }
+  }
+  void visit(WhileStmt& node) override {
+    cost += 2;
+    has_loop = true;
+    node.cond->accept(*this);
+    loop_depth++;
+    node.body->accept(*this);
+    loop_depth--;
+  }
+  void visit(BreakStmt& node) override {
+    if (loop_depth == 0) {
+      has_jump = true;
+    }
+  }
+  void visit(ContinueStmt& node) override {
+    if (loop_depth == 0) {
+      has_jump = true;
+    }
+  }
+
+  void visit(FuncCallExp& node) override {
+    cost += 1;
+    has_call = true;
+    auto param = node.rparam.get();
+    while (param) {
+      param->accept(*this);
+      param = param->next_func_rparam.get();
+    }
+  }
+  void visit(NumberExp& node) override {}
+  void visit(LValExp& node) override {
+    if (node.array_dims) {
+      array_reads.push_back(&node);
+    } else {
+      scalar_reads[node.ident] += 1;
+    }
+    visit_lval(node);
+  }
+  void visit(NegativeExp& node) override { visit_unary(node); }
+  void visit(LogicalNotExp& node) override { visit_unary(node); }
+  void visit(AddExp& node) override { visit_binary(node); }
+  void visit(SubExp& node) override { visit_binary(node); }
+  void visit(MulExp& node) override { visit_binary(node); }
+  void visit(DivExp& node) override { visit_binary(node); }
+  void visit(ModExp& node) override { visit_binary(node); }
+  void visit(LTExp& node) override { visit_binary(node); }
+  void visit(GTExp& node) override { visit_binary(node); }
+  void visit(LEExp& node) override { visit_binary(node); }
+  void visit(GEExp& node) override { visit_binary(node); }
+  void visit(EQExp& node) override { visit_binary(node); }
+  void visit(NEExp& node) override { visit_binary(node); }
+  void visit(LAndExp& node) override { visit_binary(node); }
+  void visit(LOrExp& node) override { visit_binary(node); }
+
+  void visit_list(BlockItem* item) {
+    while (item) {
+      item->accept(*this);
+      item = item->next_block_item.get();
+    }
+  }
+
+ private:
+  int loop_depth = 0;
+
+  void visit_lval(LValExp& node) {
+    cost += 1;
+    auto dim = node.array_dims.get();
+    while (dim) {
+      dim->exp->accept(*this);
+      dim = dim->next_dim.get();
+    }
+  }
+  void visit_unary(UnaryExp& node) {
+    cost += 1;
+    node.operand->accept(*this);
+  }
+  void visit_binary(BinaryExp& node) {
+    cost += 1;
+    node.lhs->accept(*this);
+    node.rhs->accept(*this);
+  }
+};
+
+// whether exp reads the scalar ident
+inline bool mentions(Exp* exp, const std::string& ident) {
+  LoopBodyVisitor summary;
+  exp->accept(summary);
+  return summary.scalar_reads.count(ident) > 0;
+}
+
+/**
+ * an add-recurrence {start, +, step}: a scalar updated exactly once per
+ * iteration by a top-level `x = x + step` / `x = x - step` of the body
+ * the step is either loop invariant or the current value of another
+ * recurrence (step_rec), which makes x a second order recurrence like
+ * `sum = sum + i`
+ */
+struct AddRecurrence {
+  std::string ident;
+  // position of the update among the top-level statements of the body
+  int update_index = -1;
+  bool known_start = false;
+  int start = 0;
+  Exp* step_exp = nullptr;
+  bool negate = false;  // x = x - step
+  bool const_step = false;
+  int step = 0;  // signed, valid if const_step
+  std::string step_rec;
+};
+
+/**
+ * result of ScalarEvolution::analyze
+ * a counted loop is `while (iv op bound) { ...; iv = iv + step; }` where
+ * 1. iv is a local scalar only written by the last statement of the body
+ * 2. op is lt / le / gt / ge and the constant step moves iv towards bound
+ * 3. bound is a constant or a scalar the body doesn't write
+ * 4. the body has no break / continue / return of this loop
+ * its trip count is max(0, ceil((bound - start) / step)) for lt (with the
+ * obvious adjustments for the others), constant if start and bound are.
+ * otherwise ScalarEvolution::gen_trip_count computes it at run time.
+ */
+struct LoopInfo {
+  bool is_counted = false;
+  std::string op;
+  AddRecurrence iv;
+  Exp* bound_exp = nullptr;
+  bool const_bound = false;
+  int bound = 0;
+  BlockItem* iv_update = nullptr;
+  bool const_trip_count = false;
+  long long trip_count = 0;
+  // the other add-recurrences of the body, in body order
+  std::vector<AddRecurrence> recurrences;
+  LoopBodyVisitor body;
+  // top-level statements of the body
+  std::vector<BlockItem*> items;
+};
+
+/**
+ * scalar evolution over the AST of a while loop
+ * GenIRVisitor emits IR as text and has no IR-level loop structure, so
+ * the analysis runs on the loop statement itself, right before it is
+ * lowered, with the symbol table of that point
+ */
+class ScalarEvolution {
+ public:
+  SymbolTables* sym_table_stack;
+
+  ScalarEvolution(SymbolTables* other_sym_table) {
+    sym_table_stack = other_sym_table;
+  }
+
+  // evaluate exp at compile time if possible
+  bool eval_const(Exp* exp, int& value) {
+    try {
+      EvaluateVisitor evaluator(sym_table_stack);
+      exp->accept(evaluator);
+      value = evaluator.result;
+      return true;
+    } catch (std::runtime_error& e) {
+      return false;
+    }
+  }
+
+  bool is_scalar_var(const std::string& ident) {
+    return sym_table_stack->find(ident) == SymbolTables::SymbolKind::VAR;
+  }
+
+  bool is_global_var(const std::string& ident) {
+    if (sym_table_stack->find_layer_num(ident,
+                                        SymbolTables::SymbolKind::VAR) == 1) {
+      return true;
+    }
+    auto sym_name = std::get<std::string>(
+        sym_table_stack->get(ident, SymbolTables::SymbolKind::VAR));
+    return sym_table_stack->promoted_globals.count(sym_name) > 0;
+  }
+
+  /**
+   * the constant value ident holds after the statements in preds (the items
+   * preceding the loop in its block), found by scanning them backwards
+   */
+  bool find_start_value(const std::vector<BlockItem*>& preds,
+                        const std::string& ident, int& value) {
+    bool global = is_global_var(ident);
+    for (int i = (int)preds.size() - 1; i >= 0; --i) {
+      if (auto assign = dynamic_cast<AssignStmt*>(preds[i])) {
+        if (assign->lval->ident == ident && !assign->lval->array_dims) {
+          return eval_const(assign->exp.get(), value);
+        }
+      } else if (auto decl = dynamic_cast<VarDecl*>(preds[i])) {
+        auto def = decl->var_def.get();
+        while (def) {
+          if (def->ident == ident) {
+            return def->array_dims == nullptr && def->var_init_val &&
+                   def->var_init_val->exp &&
+                   eval_const(def->var_init_val->exp.get(), value);
+          }
+          def = def->next_var_def.get();
+        }
+      }
+      // a local may only change by assignment, a global also by a call
+      auto item_visitor = LoopBodyVisitor();
+      preds[i]->accept(item_visitor);
+      if (item_visitor.assigned.count(ident) ||
+          item_visitor.declared.count(ident) ||
+          (global && item_visitor.has_call)) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  // exp doesn't change during the loop: constants and unwritten scalars
+  bool is_invariant(Exp* exp, const LoopBodyVisitor& body) {
+    int value;
+    if (eval_const(exp, value)) {
+      return true;
+    }
+    if (auto lval = dynamic_cast<LValExp*>(exp)) {
+      // names declared in the body are not in the symbol table yet
+      return !lval->array_dims && !body.declared.count(lval->ident) &&
+             !body.assigned.count(lval->ident) &&
+             is_scalar_var(lval->ident) &&
+             !(is_global_var(lval->ident) && body.has_call);
+    }
+    if (auto unary = dynamic_cast<NegativeExp*>(exp)) {
+      return is_invariant(unary->operand.get(), body);
+    }
+    if (dynamic_cast<AddExp*>(exp) || dynamic_cast<SubExp*>(exp) ||
+        dynamic_cast<MulExp*>(exp)) {
+      auto binary = static_cast<BinaryExp*>(exp);
+      return is_invariant(binary->lhs.get(), body) &&
+             is_invariant(binary->rhs.get(), body);
+    }
+    return false;
+  }
+
+  /**
+   * a condition that is loop invariant and can be evaluated ahead of the
+   * loop: invariant operands combined by arithmetic, comparisons and
+   * logical operators (no div / mod, they may trap)
+   */
+  bool is_invariant_cond(Exp* exp, const LoopBodyVisitor& body) {
+    if (auto unary = dynamic_cast<LogicalNotExp*>(exp)) {
+      return is_invariant_cond(unary->operand.get(), body);
+    }
+    if (dynamic_cast<LTExp*>(exp) || dynamic_cast<GTExp*>(exp) ||
+        dynamic_cast<LEExp*>(exp) || dynamic_cast<GEExp*>(exp) ||
+        dynamic_cast<EQExp*>(exp) || dynamic_cast<NEExp*>(exp) ||
+        dynamic_cast<LAndExp*>(exp) || dynamic_cast<LOrExp*>(exp)) {
+      auto binary = static_cast<BinaryExp*>(exp);
+      return is_invariant_cond(binary->lhs.get(), body) &&
+             is_invariant_cond(binary->rhs.get(), body);
+    }
+    return is_invariant(exp, body);
+  }
+
+  // match `iv`, `iv + c`, `c + iv` or `iv - c` with a constant c
+  bool match_iv_offset(Exp* exp, const std::string& iv, int& offset) {
+    auto is_iv = [&](Exp* exp) {
+      auto lval = dynamic_cast<LValExp*>(exp);
+      return lval && !lval->array_dims && lval->ident == iv;
+    };
+    if (is_iv(exp)) {
+      offset = 0;
+      return true;
+    }
+    auto binary = dynamic_cast<BinaryExp*>(exp);
+    if (dynamic_cast<AddExp*>(exp)) {
+      if (is_iv(binary->lhs.get())) {
+        return eval_const(binary->rhs.get(), offset);
+      }
+      return is_iv(binary->rhs.get()) && eval_const(binary->lhs.get(), offset);
+    }
+    if (dynamic_cast<SubExp*>(exp) && is_iv(binary->lhs.get()) &&
+        eval_const(binary->rhs.get(), offset)) {
+      offset = -offset;
+      return true;
+    }
+    return false;
+  }
+
+  // constant trip count of a counted loop, false if the values overflow
+  static bool get_trip_count(const std::string& op, long long start,
+                             long long bound, long long step,
+                             long long& trips) {
+    trips = 0;
+    if (op == "lt" && start < bound) {
+      trips = (bound - start + step - 1) / step;
+    } else if (op == "le" && start <= bound) {
+      trips = (bound - start) / step + 1;
+    } else if (op == "gt" && start > bound) {
+      trips = (start - bound - step - 1) / (-step);
+    } else if (op == "ge" && start >= bound) {
+      trips = (start - bound) / (-step) + 1;
+    }
+    long long final_value = start + trips * step;
+    return final_value >= INT32_MIN && final_value <= INT32_MAX;
+  }
+
+  /**
+   * whether GenIRVisitor::gen_unrolled_loop unrolls the loop completely:
+   * an innermost counted loop with a constant trip count (so a known start)
+   * of at most max_trips, whose copies cost at most budget, and whose
+   * final counter value is an i32
+   */
+  static bool is_fully_unrolled(const LoopInfo& info, int max_trips,
+                                int budget) {
+    if (!info.is_counted || info.body.has_loop || !info.const_trip_count) {
+      return false;
+    }
+    long long final_value = info.iv.start + info.trip_count * info.iv.step;
+    return info.trip_count <= max_trips &&
+           info.trip_count * std::max(info.body.cost, 1) <= budget &&
+           final_value >= INT32_MIN && final_value <= INT32_MAX;
+  }
+
+  /**
+   * whether the trip count of a counted loop fits in an int and can be
+   * computed in i32: the constant one if there is one, otherwise the
+   * distance between start and bound must not overflow whenever the loop
+   * runs. going up that holds for start >= 0 (bound <= INT_MAX) or
+   * bound < 0 (start >= INT_MIN), going down the other way round.
+   */
+  static bool trip_count_fits(const LoopInfo& info) {
+    if (info.const_trip_count) {
+      return info.trip_count <= INT32_MAX;
+    }
+    if (info.const_bound && info.iv.known_start) {
+      return false;  // get_trip_count saw the overflow
+    }
+    bool up = info.op == "lt" || info.op == "le";
+    bool start_side = info.iv.known_start && (info.iv.start >= 0) == up;
+    bool bound_side = info.const_bound && (info.bound < 0) == up;
+    return start_side || bound_side;
+  }
+
+  // appends `%n = op lhs, rhs` and gives %n
+  using Emit = std::function<std::string(
+      const std::string& op, const std::string& lhs, const std::string& rhs)>;
+
+  /**
+   * the IR computing the trip count of a counted loop whose count fits (see
+   * trip_count_fits), from the values start and bound hold before it
+   * t = start op bound ? (dist - 1) / |step| + 1 : 0 for lt / gt, and
+   * t = start op bound ? dist / |step| + 1 : 0 for le / ge, where dist is
+   * the distance between start and bound. a constant trip count is given
+   * as it is.
+   */
+  static std::string gen_trip_count(const LoopInfo& info,
+                                    const std::string& start,
+                                    const std::string& bound,
+                                    const Emit& emit) {
+    if (info.const_trip_count) {
+      return std::to_string(info.trip_count);
+    }
+    bool up = info.op == "lt" || info.op == "le";
+    bool strict = info.op == "lt" || info.op == "gt";
+    auto& from = up ? start : bound;
+    auto& to = up ? bound : start;
+    auto runs = emit(strict ? "gt" : "ge", to, from);
+    auto trips = emit("sub", to, from);
+    int abs_step = up ? info.iv.step : -info.iv.step;
+    if (abs_step != 1) {
+      if (strict) {
+        trips = emit("sub", trips, "1");
+      }
+      trips = emit("add", emit("div", trips, std::to_string(abs_step)), "1");
+    } else if (!strict) {
+      trips = emit("add", trips, "1");
+    }
+    return emit("and", trips, emit("sub", "0", runs));
+  }
+
+  LoopInfo analyze(WhileStmt& node, const std::vector<BlockItem*>& preds) {
+    LoopInfo info;
+    auto body = dynamic_cast<BlockStmt*>(node.body.get());
+    if (body == nullptr) {
+      return info;
+    }
+    for (auto item = body->block_item.get(); item;
+         item = item->next_block_item.get()) {
+      info.items.push_back(item);
+    }
+    info.body.visit_list(body->block_item.get());
+
+    // 1. add-recurrences among the top-level statements
+    std::vector<AddRecurrence> recs;
+    for (int i = 0; i < (int)info.items.size(); ++i) {
+      AddRecurrence rec;
+      if (match_update(info.items[i], info.body, rec)) {
+        rec.update_index = i;
+        rec.known_start = find_start_value(preds, rec.ident, rec.start);
+        recs.push_back(rec);
+      }
+    }
+    // a non-invariant step must be the value of a first order recurrence
+    std::vector<AddRecurrence> valid;
+    for (auto& rec : recs) {
+      if (rec.step_exp == nullptr) {
+        continue;
+      }
+      if (!rec.step_rec.empty()) {
+        bool found = false;
+        for (auto& other : recs) {
+          if (other.ident == rec.step_rec && other.step_rec.empty() &&
+              other.step_exp) {
+            found = true;
+          }
+        }
+        if (!found) {
+          continue;
+        }
+      }
+      valid.push_back(rec);
+    }
+
+    // 2. the induction variable of a counted loop
+    auto cond = dynamic_cast<BinaryExp*>(node.cond.get());
+    if (dynamic_cast<LTExp*>(node.cond.get())) {
+      info.op = "lt";
+    } else if (dynamic_cast<LEExp*>(node.cond.get())) {
+      info.op = "le";
+    } else if (dynamic_cast<GTExp*>(node.cond.get())) {
+      info.op = "gt";
+    } else if (dynamic_cast<GEExp*>(node.cond.get())) {
+      info.op = "ge";
+    }
+    auto iv_lval = cond ? dynamic_cast<LValExp*>(cond->lhs.get()) : nullptr;
+    for (auto& rec : valid) {
+      bool is_iv = !info.op.empty() && iv_lval && !iv_lval->array_dims &&
+                   iv_lval->ident == rec.ident && rec.const_step &&
+                   rec.step != 0 &&
+                   rec.update_index == (int)info.items.size() - 1 &&
+                   !is_global_var(rec.ident);
+      if (is_iv) {
+        info.iv = rec;
+        info.iv_update = info.items.back();
+      } else {
+        info.recurrences.push_back(rec);
+      }
+    }
+    if (info.iv_update == nullptr || info.body.has_jump) {
+      return info;
+    }
+    bool up = info.op == "lt" || info.op == "le";
+    if ((up && info.iv.step < 0) || (!up && info.iv.step > 0)) {
+      return info;
+    }
+
+    // 3. the bound
+    info.bound_exp = cond->rhs.get();
+    info.const_bound = eval_const(info.bound_exp, info.bound);
+    if (!info.const_bound) {
+      auto bound_lval = dynamic_cast<LValExp*>(info.bound_exp);
+      if (bound_lval == nullptr || !is_invariant(bound_lval, info.body)) {
+        return info;
+      }
+    }
+    info.is_counted = true;
+    if (info.const_bound && info.iv.known_start) {
+      info.const_trip_count = get_trip_count(
+          info.op, info.iv.start, info.bound, info.iv.step, info.trip_count);
+    }
+    return info;
+  }
+
+ private:
+  // match `x = x + step`, `x = step + x` or `x = x - step`
+  bool match_update(BlockItem* item, const LoopBodyVisitor& body,
+                    AddRecurrence& rec) {
+    auto assign = dynamic_cast<AssignStmt*>(item);
+    if (assign == nullptr || assign->lval->array_dims) {
+      return false;
+    }
+    auto& ident = assign->lval->ident;
+    if (body.declared.count(ident) || !is_scalar_var(ident) ||
+        body.assigned.at(ident) != 1 ||
+        (is_global_var(ident) && body.has_call)) {
+      return false;
+    }
+    auto binary = dynamic_cast<BinaryExp*>(assign->exp.get());
+    auto is_self = [&](Exp* exp) {
+      auto lval = dynamic_cast<LValExp*>(exp);
+      return lval && !lval->array_dims && lval->ident == ident;
+    };
+    if (dynamic_cast<AddExp*>(assign->exp.get())) {
+      if (is_self(binary->lhs.get())) {
+        rec.step_exp = binary->rhs.get();
+      } else if (is_self(binary->rhs.get())) {
+        rec.step_exp = binary->lhs.get();
+      } else {
+        return false;
+      }
+    } else if (dynamic_cast<SubExp*>(assign->exp.get())) {
+      if (!is_self(binary->lhs.get())) {
+        return false;
+      }
+      rec.step_exp = binary->rhs.get();
+      rec.negate = true;
+    } else {
+      return false;
+    }
+    rec.ident = ident;
+    if (eval_const(rec.step_exp, rec.step)) {
+      rec.const_step = true;
+      if (rec.negate) {
+        rec.step = -rec.step;
+      }
+      return true;
+    }
+    if (is_invariant(rec.step_exp, body)) {
+      return true;
+    }
+    auto step_lval = dynamic_cast<LValExp*>(rec.step_exp);
+    if (step_lval && !step_lval->array_dims && step_lval->ident != ident) {
+      // checked against the other recurrences by the caller
+      rec.step_rec = step_lval->ident;
+      return true;
+    }
+    return false;
+  }
+};
+
+};  // namespace AST
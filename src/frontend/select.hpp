@@ -0,0 +1,156 @@
+#pragma once
+
+#include <typeinfo>
+#include <vector>
+
+#include "ast.hpp"
+#include "visitor.hpp"
+
+namespace AST {
+
+/**
+ * structural equality of two expressions
+ * used to recognize that an array element read in a select arm has
+ * already been read by the condition
+ */
+inline bool same_exp(Exp* a, Exp* b) {
+  if (a == nullptr || b == nullptr) {
+    return a == b;
+  }
+  if (typeid(*a) != typeid(*b)) {
+    return false;
+  }
+  if (auto num = dynamic_cast<NumberExp*>(a)) {
+    return num->number == static_cast<NumberExp*>(b)->number;
+  }
+  if (auto lval = dynamic_cast<LValExp*>(a)) {
+    auto other = static_cast<LValExp*>(b);
+    if (lval->ident != other->ident) {
+      return false;
+    }
+    auto dim_a = lval->array_dims.get();
+    auto dim_b = other->array_dims.get();
+    while (dim_a && dim_b) {
+      if (!same_exp(dim_a->exp.get(), dim_b->exp.get())) {
+        return false;
+      }
+      dim_a = dim_a->next_dim.get();
+      dim_b = dim_b->next_dim.get();
+    }
+    return dim_a == dim_b;
+  }
+  if (auto unary = dynamic_cast<UnaryExp*>(a)) {
+    return same_exp(unary->operand.get(),
+                    static_cast<UnaryExp*>(b)->operand.get());
+  }
+  if (auto binary = dynamic_cast<BinaryExp*>(a)) {
+    auto other = static_cast<BinaryExp*>(b);
+    return same_exp(binary->lhs.get(), other->lhs.get()) &&
+           same_exp(binary->rhs.get(), other->rhs.get());
+  }
+  // function calls are never considered equal
+  return false;
+}
+
+/**
+ * checks whether an expression can be evaluated unconditionally
+ * (if-conversion evaluates both arms of a diamond)
+ *
+ * 1. function calls may have side effects
+ * 2. div / mod may trap on a zero divisor
+ * 3. && / || bring their own control flow
+ * 4. an array element may be out of bounds unless the very same element
+ *    is read by the condition (the common max/min pattern)
+ * cost counts the nodes, so the caller can bound the work done for the
+ * arm that is not taken
+ */
+class SelectSafetyVisitor : public Visitor {
+ public:
+  bool safe = true;
+  int cost = 0;
+  // array reads that are always evaluated before the select
+  std::vector<LValExp*> evaluated_loads;
+
+  void visit(NumberExp& node) override { cost += 1; }
+  void visit(LValExp& node) override {
+    cost += 1;
+    if (node.array_dims == nullptr) {
+      return;
+    }
+    for (auto load : evaluated_loads) {
+      if (same_exp(load, &node)) {
+        return;
+      }
+    }
+    safe = false;
+  }
+  void visit(FuncCallExp& node) override { safe = false; }
+  void visit(NegativeExp& node) override { visit_unary(node); }
+  void visit(LogicalNotExp& node) override { visit_unary(node); }
+  void visit(AddExp& node) override { visit_binary(node); }
+  void visit(SubExp& node) override { visit_binary(node); }
+  void visit(MulExp& node) override { visit_binary(node); }
+  void visit(DivExp& node) override { safe = false; }
+  void visit(ModExp& node) override { safe = false; }
+  void visit(LTExp& node) override { visit_binary(node); }
+  void visit(GTExp& node) override { visit_binary(node); }
+  void visit(LEExp& node) override { visit_binary(node); }
+  void visit(GEExp& node) override { visit_binary(node); }
+  void visit(EQExp& node) override { visit_binary(node); }
+  void visit(NEExp& node) override { visit_binary(node); }
+  void visit(LAndExp& node) override { safe = false; }
+  void visit(LOrExp& node) override { safe = false; }
+
+ private:
+  void visit_unary(UnaryExp& node) {
+    cost += 1;
+    node.operand->accept(*this);
+  }
+  void visit_binary(BinaryExp& node) {
+    cost += 1;
+    node.lhs->accept(*this);
+    node.rhs->accept(*this);
+  }
+};
+
+/**
+ * collects the array reads of a condition, so that SelectSafetyVisitor can
+ * accept arms re-reading them. loads behind a call or a short-circuit
+ * operator are skipped since they are not always evaluated.
+ */
+class CondLoadsVisitor : public Visitor {
+ public:
+  std::vector<LValExp*> loads;
+  bool has_short_circuit = false;
+
+  void visit(NumberExp& node) override {}
+  void visit(LValExp& node) override {
+    if (node.array_dims) {
+      loads.push_back(&node);
+    }
+  }
+  void visit(FuncCallExp& node) override {}
+  void visit(NegativeExp& node) override { node.operand->accept(*this); }
+  void visit(LogicalNotExp& node) override { node.operand->accept(*this); }
+  void visit(AddExp& node) override { visit_binary(node); }
+  void visit(SubExp& node) override { visit_binary(node); }
+  void visit(MulExp& node) override { visit_binary(node); }
+  void visit(DivExp& node) override { visit_binary(node); }
+  void visit(ModExp& node) override { visit_binary(node); }
+  void visit(LTExp& node) override { visit_binary(node); }
+  void visit(GTExp& node) override { visit_binary(node); }
+  void visit(LEExp& node) override { visit_binary(node); }
+  void visit(GEExp& node) override { visit_binary(node); }
+  void visit(EQExp& node) override { visit_binary(node); }
+  void visit(NEExp& node) override { visit_binary(node); }
+  void visit(LAndExp& node) override { has_short_circuit = true; }
+  void visit(LOrExp& node) override { has_short_circuit = true; }
+
+ private:
+  void visit_binary(BinaryExp& node) {
+    node.lhs->accept(*this);
+    node.rhs->accept(*this);
+  }
+};
+
+};  // namespace AST
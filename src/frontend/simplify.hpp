@@ -0,0 +1,433 @@
+#pragma once
+
+#include <climits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "ast.hpp"
+#include "select.hpp"
+#include "visitor.hpp"
+
+namespace AST {
+
+/**
+ * algebraic simplification of the expressions of a function body, run on
+ * the ast before anything else looks at it
+ * 1. constants fold, and move to the right of commutative operators and
+ *    comparisons (3 < x becomes x > 3)
+ * 2. chains of + / - (and unary -) are flattened into terms: the constants
+ *    are summed into one trailing constant, and a term cancels an equal one
+ *    of the opposite sign (x - x). ((a + 1) + 2) + b becomes (a + b) + 3
+ * 3. chains of * likewise: the constants are multiplied into one factor,
+ *    x * 1 becomes x, x * -1 becomes -x and x * 0 becomes 0
+ * 4. x / 1, x / -1, x % 1, !!x (x != 0), !(a == b) (a != b), and && / ||
+ *    with a constant side
+ * terms keep their source order, so calls still happen in that order, and
+ * nothing containing a call is ever dropped. the chains are not balanced:
+ * the backend keeps every value in a stack slot, so a tree exposes no more
+ * parallelism than a chain.
+ */
+class SimplifyVisitor : public Visitor {
+ public:
+  void visit(ConstDecl& node) override {}
+  void visit(VarDecl& node) override {
+    auto def = node.var_def.get();
+    while (def) {
+      if (def->var_init_val) {
+        def->var_init_val->accept(*this);
+      }
+      def = def->next_var_def.get();
+    }
+  }
+  void visit(ArrayInitVal& node) override {
+    if (node.exp) {
+      simplify(node.exp);
+    }
+    for (auto& sub : node.array_init_val_hierarchy) {
+      sub->accept(*this);
+    }
+  }
+
+  void visit(RetStmt& node) override {
+    if (node.exp) {
+      simplify(node.exp);
+    }
+  }
+  void visit(AssignStmt& node) override {
+    simplify_dims(*node.lval);
+    simplify(node.exp);
+  }
+  void visit(ExpStmt& node) override {
+    if (node.exp) {
+      simplify(node.exp);
+    }
+  }
+  void visit(BlockStmt& node) override { visit_list(node.block_item.get()); }
+  void visit(IfStmt& node) override {
+    simplify(node.cond);
+    node.then_body->accept(*this);
+    if (node.else_body) {
+      node.else_body->accept(*this);
+    }
+  }
+  void visit(WhileStmt& node) override {
+    simplify(node.cond);
+    node.body->accept(*this);
+  }
+  void visit(BreakStmt& node) override {}
+  void visit(ContinueStmt& node) override {}
+
+  void visit_list(BlockItem* item) {
+    while (item) {
+      item->accept(*this);
+      item = item->next_block_item.get();
+    }
+  }
+
+ private:
+  using Term = std::pair<std::unique_ptr<Exp>, bool>;  // (exp, negated)
+
+  // rewrite the expression held by slot in place
+  void simplify(std::unique_ptr<Exp>& slot) {
+    // the link of an argument list belongs to the slot, not the expression
+    auto next = std::move(slot->next_func_rparam);
+    slot = rewrite(std::move(slot));
+    slot->next_func_rparam = std::move(next);
+  }
+
+  void simplify_dims(LValExp& node) {
+    auto dim = node.array_dims.get();
+    while (dim) {
+      simplify(dim->exp);
+      dim = dim->next_dim.get();
+    }
+  }
+
+  std::unique_ptr<Exp> rewrite(std::unique_ptr<Exp> exp) {
+    auto raw = exp.get();
+    if (auto lval = dynamic_cast<LValExp*>(raw)) {
+      simplify_dims(*lval);
+      return exp;
+    }
+    if (auto call = dynamic_cast<FuncCallExp*>(raw)) {
+      auto slot = &call->rparam;
+      while (*slot) {
+        simplify(*slot);
+        slot = &(*slot)->next_func_rparam;
+      }
+      return exp;
+    }
+    if (auto unary = dynamic_cast<UnaryExp*>(raw)) {
+      unary->operand = rewrite(std::move(unary->operand));
+      if (dynamic_cast<NegativeExp*>(raw)) {
+        return rewrite_sum(std::move(exp));
+      }
+      return rewrite_not(std::move(exp));
+    }
+    auto binary = dynamic_cast<BinaryExp*>(raw);
+    if (binary == nullptr) {
+      return exp;
+    }
+    binary->lhs = rewrite(std::move(binary->lhs));
+    binary->rhs = rewrite(std::move(binary->rhs));
+    if (dynamic_cast<AddExp*>(raw) || dynamic_cast<SubExp*>(raw)) {
+      return rewrite_sum(std::move(exp));
+    }
+    if (dynamic_cast<MulExp*>(raw)) {
+      return rewrite_product(std::move(exp));
+    }
+    if (dynamic_cast<DivExp*>(raw) || dynamic_cast<ModExp*>(raw)) {
+      return rewrite_division(std::move(exp));
+    }
+    if (dynamic_cast<LAndExp*>(raw) || dynamic_cast<LOrExp*>(raw)) {
+      return rewrite_logical(std::move(exp));
+    }
+    return rewrite_compare(std::move(exp));
+  }
+
+  std::unique_ptr<Exp> rewrite_sum(std::unique_ptr<Exp> exp) {
+    std::vector<Term> terms;
+    unsigned constant = 0;
+    flatten_sum(std::move(exp), false, terms, constant);
+    // x - x
+    for (int i = 0; i < (int)terms.size(); ++i) {
+      for (int j = i + 1; terms[i].first && j < (int)terms.size(); ++j) {
+        if (terms[j].first && terms[i].second != terms[j].second &&
+            same_exp(terms[i].first.get(), terms[j].first.get()) &&
+            !has_call(terms[i].first.get())) {
+          terms[i].first.reset();
+          terms[j].first.reset();
+        }
+      }
+    }
+    std::unique_ptr<Exp> result;
+    for (auto& [term, negated] : terms) {
+      if (term == nullptr) {
+        continue;
+      }
+      if (result) {
+        result =
+            negated ? make_binary<SubExp>(std::move(result), std::move(term))
+                    : make_binary<AddExp>(std::move(result), std::move(term));
+      } else if (!negated) {
+        result = std::move(term);
+      } else if (constant != 0) {
+        // c - x, the constant is used up
+        result =
+            make_binary<SubExp>(make_number((int)constant), std::move(term));
+        constant = 0;
+      } else {
+        result = make_unary<NegativeExp>(std::move(term));
+      }
+    }
+    int value = (int)constant;
+    if (result == nullptr) {
+      return make_number(value);
+    }
+    if (value < 0 && value != INT_MIN) {
+      return make_binary<SubExp>(std::move(result), make_number(-value));
+    }
+    if (value != 0) {
+      return make_binary<AddExp>(std::move(result), make_number(value));
+    }
+    return result;
+  }
+
+  void flatten_sum(std::unique_ptr<Exp> exp, bool negated,
+                   std::vector<Term>& terms, unsigned& constant) {
+    auto raw = exp.get();
+    if (auto num = dynamic_cast<NumberExp*>(raw)) {
+      constant += negated ? -(unsigned)num->number : (unsigned)num->number;
+    } else if (dynamic_cast<AddExp*>(raw) || dynamic_cast<SubExp*>(raw)) {
+      auto binary = static_cast<BinaryExp*>(raw);
+      flatten_sum(std::move(binary->lhs), negated, terms, constant);
+      flatten_sum(std::move(binary->rhs),
+                  dynamic_cast<SubExp*>(raw) ? !negated : negated, terms,
+                  constant);
+    } else if (auto neg = dynamic_cast<NegativeExp*>(raw)) {
+      flatten_sum(std::move(neg->operand), !negated, terms, constant);
+    } else {
+      terms.push_back({std::move(exp), negated});
+    }
+  }
+
+  std::unique_ptr<Exp> rewrite_product(std::unique_ptr<Exp> exp) {
+    std::vector<std::unique_ptr<Exp>> factors;
+    unsigned constant = 1;
+    flatten_product(std::move(exp), factors, constant);
+    bool pure = true;
+    for (auto& factor : factors) {
+      pure = pure && !has_call(factor.get());
+    }
+    int value = (int)constant;
+    if (factors.empty() || (value == 0 && pure)) {
+      return make_number(value);
+    }
+    std::unique_ptr<Exp> result;
+    for (auto& factor : factors) {
+      result = result
+                   ? make_binary<MulExp>(std::move(result), std::move(factor))
+                   : std::move(factor);
+    }
+    if (value == 1) {
+      return result;
+    }
+    if (value == -1) {
+      return make_unary<NegativeExp>(std::move(result));
+    }
+    return make_binary<MulExp>(std::move(result), make_number(value));
+  }
+
+  void flatten_product(std::unique_ptr<Exp> exp,
+                       std::vector<std::unique_ptr<Exp>>& factors,
+                       unsigned& constant) {
+    auto raw = exp.get();
+    if (auto num = dynamic_cast<NumberExp*>(raw)) {
+      constant *= (unsigned)num->number;
+    } else if (auto mul = dynamic_cast<MulExp*>(raw)) {
+      flatten_product(std::move(mul->lhs), factors, constant);
+      flatten_product(std::move(mul->rhs), factors, constant);
+    } else if (auto neg = dynamic_cast<NegativeExp*>(raw)) {
+      constant = -constant;
+      flatten_product(std::move(neg->operand), factors, constant);
+    } else {
+      factors.push_back(std::move(exp));
+    }
+  }
+
+  std::unique_ptr<Exp> rewrite_division(std::unique_ptr<Exp> exp) {
+    auto binary = static_cast<BinaryExp*>(exp.get());
+    bool mod = dynamic_cast<ModExp*>(binary) != nullptr;
+    auto lhs = dynamic_cast<NumberExp*>(binary->lhs.get());
+    auto rhs = dynamic_cast<NumberExp*>(binary->rhs.get());
+    if (rhs == nullptr || rhs->number == 0) {
+      return exp;
+    }
+    int divisor = rhs->number;
+    if (lhs) {
+      // INT_MIN / -1 overflows, leave it to run time
+      if (lhs->number == INT_MIN && divisor == -1) {
+        return exp;
+      }
+      return make_number(mod ? lhs->number % divisor : lhs->number / divisor);
+    }
+    if (divisor == 1 || divisor == -1) {
+      if (mod) {
+        return has_call(binary->lhs.get()) ? std::move(exp) : make_number(0);
+      }
+      if (divisor == 1) {
+        return std::move(binary->lhs);
+      }
+      return rewrite_sum(make_unary<NegativeExp>(std::move(binary->lhs)));
+    }
+    return exp;
+  }
+
+  std::unique_ptr<Exp> rewrite_compare(std::unique_ptr<Exp> exp) {
+    auto binary = static_cast<BinaryExp*>(exp.get());
+    auto lhs = dynamic_cast<NumberExp*>(binary->lhs.get());
+    auto rhs = dynamic_cast<NumberExp*>(binary->rhs.get());
+    bool lt = dynamic_cast<LTExp*>(binary), gt = dynamic_cast<GTExp*>(binary);
+    bool le = dynamic_cast<LEExp*>(binary), ge = dynamic_cast<GEExp*>(binary);
+    bool eq = dynamic_cast<EQExp*>(binary);
+    if (lhs && rhs) {
+      int a = lhs->number, b = rhs->number;
+      return make_number(lt   ? a < b
+                         : gt ? a > b
+                         : le ? a <= b
+                         : ge ? a >= b
+                         : eq ? a == b
+                              : a != b);
+    }
+    if (same_exp(binary->lhs.get(), binary->rhs.get()) &&
+        !has_call(binary->lhs.get())) {
+      return make_number(le || ge || eq);
+    }
+    if (lhs == nullptr) {
+      return exp;
+    }
+    // the constant goes to the right
+    auto a = std::move(binary->lhs), b = std::move(binary->rhs);
+    if (lt) {
+      return make_binary<GTExp>(std::move(b), std::move(a));
+    }
+    if (gt) {
+      return make_binary<LTExp>(std::move(b), std::move(a));
+    }
+    if (le) {
+      return make_binary<GEExp>(std::move(b), std::move(a));
+    }
+    if (ge) {
+      return make_binary<LEExp>(std::move(b), std::move(a));
+    }
+    if (eq) {
+      return make_binary<EQExp>(std::move(b), std::move(a));
+    }
+    return make_binary<NEExp>(std::move(b), std::move(a));
+  }
+
+  std::unique_ptr<Exp> rewrite_not(std::unique_ptr<Exp> exp) {
+    auto& operand = static_cast<UnaryExp*>(exp.get())->operand;
+    if (auto num = dynamic_cast<NumberExp*>(operand.get())) {
+      return make_number(!num->number);
+    }
+    if (auto inner = dynamic_cast<LogicalNotExp*>(operand.get())) {
+      return to_bool(std::move(inner->operand));
+    }
+    if (auto eq = dynamic_cast<EQExp*>(operand.get())) {
+      return make_binary<NEExp>(std::move(eq->lhs), std::move(eq->rhs));
+    }
+    if (auto ne = dynamic_cast<NEExp*>(operand.get())) {
+      return make_binary<EQExp>(std::move(ne->lhs), std::move(ne->rhs));
+    }
+    return exp;
+  }
+
+  std::unique_ptr<Exp> rewrite_logical(std::unique_ptr<Exp> exp) {
+    auto binary = static_cast<BinaryExp*>(exp.get());
+    bool land = dynamic_cast<LAndExp*>(binary) != nullptr;
+    // the value that decides the result on its own: 0 for &&, 1 for ||
+    auto decides = [&](NumberExp* num) {
+      return land ? num->number == 0 : num->number != 0;
+    };
+    if (auto lhs = dynamic_cast<NumberExp*>(binary->lhs.get())) {
+      if (decides(lhs)) {
+        return make_number(!land);
+      }
+      return to_bool(std::move(binary->rhs));
+    }
+    if (auto rhs = dynamic_cast<NumberExp*>(binary->rhs.get())) {
+      if (!decides(rhs)) {
+        return to_bool(std::move(binary->lhs));
+      }
+      if (!has_call(binary->lhs.get())) {
+        return make_number(!land);
+      }
+    }
+    return exp;
+  }
+
+  // exp as 0 / 1
+  std::unique_ptr<Exp> to_bool(std::unique_ptr<Exp> exp) {
+    auto raw = exp.get();
+    if (auto num = dynamic_cast<NumberExp*>(raw)) {
+      return make_number(num->number != 0);
+    }
+    if (dynamic_cast<LogicalNotExp*>(raw) || dynamic_cast<LAndExp*>(raw) ||
+        dynamic_cast<LOrExp*>(raw) || dynamic_cast<LTExp*>(raw) ||
+        dynamic_cast<GTExp*>(raw) || dynamic_cast<LEExp*>(raw) ||
+        dynamic_cast<GEExp*>(raw) || dynamic_cast<EQExp*>(raw) ||
+        dynamic_cast<NEExp*>(raw)) {
+      return exp;
+    }
+    return make_binary<NEExp>(std::move(exp), make_number(0));
+  }
+
+  static bool has_call(Exp* exp) {
+    if (exp == nullptr || dynamic_cast<FuncCallExp*>(exp)) {
+      return exp != nullptr;
+    }
+    if (auto lval = dynamic_cast<LValExp*>(exp)) {
+      auto dim = lval->array_dims.get();
+      while (dim) {
+        if (has_call(dim->exp.get())) {
+          return true;
+        }
+        dim = dim->next_dim.get();
+      }
+      return false;
+    }
+    if (auto unary = dynamic_cast<UnaryExp*>(exp)) {
+      return has_call(unary->operand.get());
+    }
+    if (auto binary = dynamic_cast<BinaryExp*>(exp)) {
+      return has_call(binary->lhs.get()) || has_call(binary->rhs.get());
+    }
+    return false;
+  }
+
+  static std::unique_ptr<Exp> make_number(int value) {
+    auto num = std::make_unique<NumberExp>();
+    num->number = value;
+    return num;
+  }
+
+  template <typename T>
+  static std::unique_ptr<Exp> make_unary(std::unique_ptr<Exp> operand) {
+    auto unary = std::make_unique<T>();
+    unary->operand = std::move(operand);
+    return unary;
+  }
+
+  template <typename T>
+  static std::unique_ptr<Exp> make_binary(std::unique_ptr<Exp> lhs,
+                                          std::unique_ptr<Exp> rhs) {
+    auto binary = std::make_unique<T>();
+    binary->lhs = std::move(lhs);
+    binary->rhs = std::move(rhs);
+    return binary;
+  }
+};
+
+}  // namespace AST
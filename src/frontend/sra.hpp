@@ -0,0 +1,263 @@
+#pragma once
+
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "ast.hpp"
+#include "eval.hpp"
+#include "scev.hpp"
+#include "symtable.hpp"
+#include "visitor.hpp"
+
+namespace AST {
+
+/**
+ * checks the uses of a local array in the statements after its
+ * declaration, to decide whether it can be split into one scalar per
+ * element (scalar replacement of aggregates)
+ * 1. every use must be a full element access a[e1]..[en]. a bare `a` or a
+ *    row `a[e1]` passes the address on (to a call), so the array escapes
+ * 2. every index must be a constant when the access is lowered: constant
+ *    right away, or inside a loop ScalarEvolution proves gen_unrolled_loop
+ *    unrolls completely, constant in every copy with the counter bound to
+ *    its value there
+ * 3. every such constant must be in range, an access out of range is left
+ *    to the array in memory
+ * replaceable is cleared by 1 and 3, dynamic counts the indices failing 2.
+ * GenIRVisitor only replaces arrays without either.
+ */
+class ArrayUseVisitor : public Visitor {
+ public:
+  bool replaceable = true;
+  int dynamic = 0;
+
+  // max_trips and budget are the limits of full unrolling
+  ArrayUseVisitor(SymbolTables* other_sym_table, const std::string& _ident,
+                  const std::vector<int>& _dims, int _max_trips, int _budget)
+      : sym_table_stack(other_sym_table),
+        ident(_ident),
+        dims(_dims),
+        max_trips(_max_trips),
+        budget(_budget) {}
+
+  /**
+   * the uses after the array: the later defs of its declaration, then the
+   * items after it (preceded by before in their list). the names declared
+   * there go into a table of their own, so ScalarEvolution finds them like
+   * it does when the loop is lowered
+   */
+  void visit_rest(VarDef* def, BlockItem* item,
+                  const std::vector<BlockItem*>& before) {
+    sym_table_stack->push_table();
+    visit_defs(def);
+    visit_list(item, before);
+    sym_table_stack->pop_table();
+  }
+
+  void visit(ConstDecl& node) override {
+    auto def = node.const_def.get();
+    while (def) {
+      // shadowed in an inner block, not worth telling the two apart
+      if (def->ident == ident) {
+        replaceable = false;
+      }
+      if (def->array_dims) {
+        sym_table_stack->insert_to_top(def->ident, std::vector<int>(),
+                                       std::vector<int>(),
+                                       SymbolTables::SymbolKind::CONST_ARR);
+      } else {
+        EvaluateVisitor evaluator(sym_table_stack);
+        def->const_init_val->exp->accept(evaluator);
+        sym_table_stack->insert_to_top(def->ident, evaluator.result);
+      }
+      def = def->next_const_def.get();
+    }
+  }
+  void visit(VarDecl& node) override { visit_defs(node.var_def.get()); }
+  void visit(ArrayInitVal& node) override {
+    if (node.exp) {
+      node.exp->accept(*this);
+    }
+    for (auto& sub : node.array_init_val_hierarchy) {
+      sub->accept(*this);
+    }
+  }
+
+  void visit(RetStmt& node) override {
+    if (node.exp) {
+      node.exp->accept(*this);
+    }
+  }
+  void visit(AssignStmt& node) override {
+    node.lval->accept(*this);
+    node.exp->accept(*this);
+  }
+  void visit(ExpStmt& node) override {
+    if (node.exp) {
+      node.exp->accept(*this);
+    }
+  }
+  void visit(BlockStmt& node) override {
+    sym_table_stack->push_table();
+    visit_list(node.block_item.get());
+    sym_table_stack->pop_table();
+  }
+  void visit(IfStmt& node) override {
+    node.cond->accept(*this);
+    node.then_body->accept(*this);
+    if (node.else_body) {
+      node.else_body->accept(*this);
+    }
+  }
+  void visit(WhileStmt& node) override {
+    node.cond->accept(*this);
+    // the body of a fully unrolled loop has no loops, so there is at most
+    // one counter at a time
+    std::vector<BlockItem*> preceding;
+    if (!lists.empty() && !lists.back().empty() &&
+        lists.back().back() == &node) {
+      preceding.assign(lists.back().begin(), lists.back().end() - 1);
+    }
+    auto scev = ScalarEvolution(sym_table_stack);
+    auto info = scev.analyze(node, preceding);
+    if (!counter.empty() ||
+        !scev.is_fully_unrolled(info, max_trips, budget)) {
+      node.body->accept(*this);
+      return;
+    }
+    counter = info.iv.ident;
+    for (int k = 0; k < info.trip_count; ++k) {
+      counter_values.push_back(info.iv.start + k * info.iv.step);
+    }
+    node.body->accept(*this);
+    counter.clear();
+    counter_values.clear();
+  }
+  void visit(BreakStmt& node) override {}
+  void visit(ContinueStmt& node) override {}
+
+  void visit(FuncCallExp& node) override {
+    auto param = node.rparam.get();
+    while (param) {
+      param->accept(*this);
+      param = param->next_func_rparam.get();
+    }
+  }
+  void visit(NumberExp& node) override {}
+  void visit(LValExp& node) override {
+    int refer_dim = 0;
+    auto dim = node.array_dims.get();
+    while (dim) {
+      dim->exp->accept(*this);
+      if (node.ident == ident) {
+        check_index(dim->exp.get(), dims[refer_dim]);
+      }
+      refer_dim += 1;
+      dim = dim->next_dim.get();
+    }
+    if (node.ident == ident && refer_dim != (int)dims.size()) {
+      replaceable = false;
+    }
+  }
+  void visit(NegativeExp& node) override { node.operand->accept(*this); }
+  void visit(LogicalNotExp& node) override { node.operand->accept(*this); }
+  void visit(AddExp& node) override { visit_binary(node); }
+  void visit(SubExp& node) override { visit_binary(node); }
+  void visit(MulExp& node) override { visit_binary(node); }
+  void visit(DivExp& node) override { visit_binary(node); }
+  void visit(ModExp& node) override { visit_binary(node); }
+  void visit(LTExp& node) override { visit_binary(node); }
+  void visit(GTExp& node) override { visit_binary(node); }
+  void visit(LEExp& node) override { visit_binary(node); }
+  void visit(GEExp& node) override { visit_binary(node); }
+  void visit(EQExp& node) override { visit_binary(node); }
+  void visit(NEExp& node) override { visit_binary(node); }
+  void visit(LAndExp& node) override { visit_binary(node); }
+  void visit(LOrExp& node) override { visit_binary(node); }
+
+  // before: the statements preceding item in its list
+  void visit_list(BlockItem* item,
+                  const std::vector<BlockItem*>& before = {}) {
+    lists.push_back(before);
+    while (item && replaceable) {
+      lists.back().push_back(item);
+      item->accept(*this);
+      item = item->next_block_item.get();
+    }
+    lists.pop_back();
+  }
+
+ private:
+  SymbolTables* sym_table_stack;
+  std::string ident;
+  std::vector<int> dims;
+  int max_trips;
+  int budget;
+  // the statements visited so far of every enclosing list, for the
+  // start value of a loop counter
+  std::vector<std::vector<BlockItem*>> lists;
+  // counter of the enclosing fully unrolled loop and its value in every copy
+  std::string counter;
+  std::vector<int> counter_values;
+
+  // only the kind of a var matters to ScalarEvolution, not its IR name
+  void visit_defs(VarDef* def) {
+    while (def) {
+      if (def->ident == ident) {
+        replaceable = false;
+      }
+      if (def->var_init_val) {
+        def->var_init_val->accept(*this);
+      }
+      if (def->array_dims) {
+        sym_table_stack->insert_to_top(
+            def->ident, std::vector<int>(),
+            std::vector<std::variant<Exp*, int>>(),
+            SymbolTables::SymbolKind::VAR_ARR);
+      } else {
+        sym_table_stack->insert_to_top(def->ident, "%" + def->ident,
+                                       SymbolTables::SymbolKind::VAR);
+      }
+      def = def->next_var_def.get();
+    }
+  }
+
+  void visit_binary(BinaryExp& node) {
+    node.lhs->accept(*this);
+    node.rhs->accept(*this);
+  }
+
+  void check_index(Exp* exp, int dim) {
+    if (counter.empty()) {
+      check_index_value(exp, dim);
+      return;
+    }
+    for (auto value : counter_values) {
+      sym_table_stack->push_table();
+      sym_table_stack->insert_to_top(counter, value);
+      bool is_const = check_index_value(exp, dim);
+      sym_table_stack->pop_table();
+      if (!is_const) {
+        return;
+      }
+    }
+  }
+
+  // false if exp is not a constant
+  bool check_index_value(Exp* exp, int dim) {
+    try {
+      EvaluateVisitor evaluator(sym_table_stack);
+      exp->accept(evaluator);
+      if (evaluator.result < 0 || evaluator.result >= dim) {
+        replaceable = false;
+      }
+      return true;
+    } catch (std::runtime_error& e) {
+      dynamic += 1;
+      return false;
+    }
+  }
+};
+
+}  // namespace AST
@@ -3,6 +3,7 @@
 #include <memory>
 #include "visitor.hpp"
 #include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
@@ -20,6 +21,8 @@ class SymbolTables {
     std::string sym_name;
     std::vector<int> dims;
     std::vector<std::variant<Exp*, int>> data;
+    // one scalar per element (row-major) if the array is scalar-replaced
+    std::vector<std::string> scalars;
   };
 
   struct PtrInfo {
@@ -296,6 +299,10 @@ class SymbolTables {
     }
   }
 
+  // locals standing in for a global scalar inside a loop, they still
+  // behave like the global for anything outside the loop (e.g. calls)
+  std::unordered_set<std::string> promoted_globals;
+
   int const_count = -1;
   int var_count = -1;
   int const_array_count = -1;
@@ -441,6 +448,11 @@ class SymbolTables {
     throw std::runtime_error("undefined var array symbol: " + ident);
   }
 
+  void set_var_arr_scalars(const std::string& ident,
+                           const std::vector<std::string>& scalars) {
+    var_arr_sym_table_stack.back().at(ident).scalars = scalars;
+  }
+
   PtrInfo get_ptr_info(const std::string& ident) {
     for (auto it = ptr_sym_table_stack.rbegin();
          it != ptr_sym_table_stack.rend(); it++) {
@@ -20,11 +20,27 @@ extern int yyparse(unique_ptr<AST::CompUnit>& ast);
 
 int main(int argc, const char* argv[]) {
   // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-  // compiler 模式 输入文件 -o 输出文件
-  assert(argc == 5);
+  // compiler 模式 输入文件 -o 输出文件 [-march=rv32imv]
+  assert(argc >= 5);
   auto mode = std::string(argv[1]);
   auto input = std::string(argv[2]);
   auto output = std::string(argv[4]);
+  bool vector_ext = false;
+  // -fprofile-generate[=file] counts the edges taken at run time into file,
+  // -fprofile-use=file compiles with those counts
+  std::string profile_generate, profile_use;
+  for (int i = 5; i < argc; ++i) {
+    auto arg = std::string(argv[i]);
+    if (arg == "-march=rv32imv") {
+      vector_ext = true;
+    } else if (arg == "-fprofile-generate") {
+      profile_generate = "sysy.profile";
+    } else if (arg.rfind("-fprofile-generate=", 0) == 0) {
+      profile_generate = arg.substr(arg.find('=') + 1);
+    } else if (arg.rfind("-fprofile-use=", 0) == 0) {
+      profile_use = arg.substr(arg.find('=') + 1);
+    }
+  }
 
   // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
   yyin = fopen(input.c_str(), "r");
@@ -42,6 +58,7 @@ int main(int argc, const char* argv[]) {
 
   // 输出解析得到的 AST, 其实就是个字符串
   auto ir_visitor = AST::GenIRVisitor();
+  ir_visitor.vectorize = vector_ext;
   ast->accept(ir_visitor);
   std::cout << "end genIR" << std::endl;
   auto& ir = ir_visitor.ir_code;
@@ -57,9 +74,9 @@ int main(int argc, const char* argv[]) {
       fclose(output_file);
     }
   } else if (mode == "-riscv") {
-    IR_to_ASM(ir, output);
+    IR_to_ASM(ir, output, profile_generate, profile_use);
   } else if (mode == "-perf") {
-    IR_to_ASM(ir, output);
+    IR_to_ASM(ir, output, profile_generate, profile_use);
   }
 
   return 0;